@@ -0,0 +1,61 @@
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION sachem UPDATE TO '2.6'" to load this file. \quit
+
+
+ALTER TABLE configuration ADD COLUMN match_images BOOLEAN NOT NULL DEFAULT false;
+ALTER TABLE configuration ADD COLUMN dense_fingerprints BOOLEAN NOT NULL DEFAULT false;
+
+
+CREATE FUNCTION "substructure_explain"(varchar, varchar, search_mode = 'SUBSTRUCTURE', charge_mode = 'DEFAULT_AS_ANY', isotope_mode = 'IGNORE', radical_mode = 'IGNORE', stereo_mode = 'IGNORE', aromaticity_mode = 'AUTO', tautomer_mode = 'IGNORE') RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+
+
+DROP FUNCTION "add_index"(varchar, varchar, varchar, varchar, varchar, int, int, int, float8);
+
+
+CREATE FUNCTION "add_index"(index_name varchar, schema_name varchar, table_name varchar, id_column varchar = 'id', molfile_column varchar = 'molfile', threads int = 4, segments int = 4, buffered_docs int = 1000, buffer_size float8 = 64, match_images boolean = false, dense_fingerprints boolean = false) RETURNS void AS $$
+DECLARE
+    idx int;
+BEGIN
+	INSERT INTO sachem.configuration (index_name, schema_name, table_name, id_column, molfile_column, threads, segments, buffered_docs, buffer_size, match_images, dense_fingerprints, version) VALUES (index_name, schema_name, table_name, id_column, molfile_column, threads, segments, buffered_docs, buffer_size, match_images, dense_fingerprints, 0);
+
+	SELECT id INTO idx FROM sachem.configuration AS tbl WHERE tbl.index_name = "add_index".index_name;
+	
+	schema_name := quote_ident(schema_name);
+	table_name := quote_ident(table_name);
+    id_column := quote_ident(id_column);
+    molfile_column := quote_ident(molfile_column);	
+    
+	EXECUTE 'CREATE FUNCTION sachem."' || index_name || '_compound_audit"() RETURNS TRIGGER AS
+	$body$
+	BEGIN
+	  IF (TG_OP = ''INSERT'') THEN
+	    INSERT INTO sachem.compound_audit (index, id, delete) VALUES (' || idx || ', NEW.' || id_column || ', false)
+	        ON CONFLICT DO NOTHING;
+	    RETURN NEW;
+	  ELSIF (TG_OP = ''UPDATE'') THEN
+	    IF (OLD.' || molfile_column || ' != NEW.' || molfile_column || ') THEN
+	        INSERT INTO sachem.compound_audit (index, id, delete) VALUES (' || idx || ', NEW.' || id_column || ', true)
+	            ON CONFLICT (index, id) DO UPDATE SET index=EXCLUDED.index, id=EXCLUDED.id, delete=true;
+	    END IF;
+	    RETURN NEW;
+	  ELSIF (TG_OP = ''DELETE'') THEN
+	    INSERT INTO sachem.compound_audit (index, id, delete) VALUES (' || idx || ', OLD.' || id_column || ', true)
+	        ON CONFLICT (index, id) DO UPDATE SET index=EXCLUDED.index, id=EXCLUDED.id, delete=true;
+	    RETURN OLD;
+	  ELSIF (TG_OP = ''TRUNCATE'') THEN
+	    INSERT INTO sachem.compound_audit SELECT ' || idx || ', ' || id_column || ', true FROM ' || schema_name || '.' || table_name || '
+	        ON CONFLICT (index, id) DO UPDATE SET index=EXCLUDED.index, id=EXCLUDED.id, delete=true;
+	    RETURN NULL;
+	  END IF;
+	END;
+	$body$ LANGUAGE plpgsql SECURITY DEFINER';
+	
+    EXECUTE 'CREATE TRIGGER "' || index_name || '_sachem_compound_audit" AFTER INSERT OR UPDATE OR DELETE ON ' ||
+        schema_name || '.' || table_name || ' FOR EACH ROW EXECUTE PROCEDURE sachem."' || index_name || '_compound_audit"()';
+	
+	EXECUTE 'CREATE TRIGGER "' || index_name || '_sachem_truncate_compound_audit" BEFORE TRUNCATE ON ' ||
+	    schema_name || '.' || table_name ||  ' FOR EACH STATEMENT EXECUTE PROCEDURE sachem."' || index_name || '_compound_audit"()';
+    
+	EXECUTE 'INSERT INTO sachem.compound_audit (index, id, delete) SELECT ' || idx || ', ' || id_column || ', false FROM ' || schema_name || '.' || table_name;
+END
+$$ LANGUAGE PLPGSQL STRICT SECURITY DEFINER;
@@ -0,0 +1,56 @@
+CREATE EXTENSION sachem;
+CREATE TABLE bridging_hydrogen (id int PRIMARY KEY, molfile text);
+-- diborane, both bridging hydrogens are bonded to two boron atoms
+INSERT INTO bridging_hydrogen VALUES (1, '
+  sachem
+
+  8  8  0  0  0  0  0  0  0  0999 V2000
+    0.0000    0.0000    0.0000 B   0  0  0  0  0  0  0  0  0  0  0  0
+    1.7500    0.0000    0.0000 B   0  0  0  0  0  0  0  0  0  0  0  0
+    0.8750    0.9000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    0.8750   -0.9000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+   -0.6000    1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+   -0.6000   -1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    2.3500    1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    2.3500   -1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+  1  3  1  0  0  0  0
+  2  3  1  0  0  0  0
+  1  4  1  0  0  0  0
+  2  4  1  0  0  0  0
+  1  5  1  0  0  0  0
+  1  6  1  0  0  0  0
+  2  7  1  0  0  0  0
+  2  8  1  0  0  0  0
+M  END
+');
+-- the same atoms with an additional boron-boron bond
+INSERT INTO bridging_hydrogen VALUES (2, '
+  sachem
+
+  8  9  0  0  0  0  0  0  0  0999 V2000
+    0.0000    0.0000    0.0000 B   0  0  0  0  0  0  0  0  0  0  0  0
+    1.7500    0.0000    0.0000 B   0  0  0  0  0  0  0  0  0  0  0  0
+    0.8750    0.9000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    0.8750   -0.9000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+   -0.6000    1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+   -0.6000   -1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    2.3500    1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+    2.3500   -1.0000    0.0000 H   0  0  0  0  0  0  0  0  0  0  0  0
+  1  3  1  0  0  0  0
+  2  3  1  0  0  0  0
+  1  4  1  0  0  0  0
+  2  4  1  0  0  0  0
+  1  5  1  0  0  0  0
+  1  6  1  0  0  0  0
+  2  7  1  0  0  0  0
+  2  8  1  0  0  0  0
+  1  2  1  0  0  0  0
+M  END
+');
+SELECT sachem.add_index('bridging_hydrogen', 'public', 'bridging_hydrogen');
+SELECT sachem.sync_data('bridging_hydrogen');
+-- the molecule matches itself exactly, but not the molecule with the additional heavy bond
+SELECT compound, score FROM sachem.substructure_search('bridging_hydrogen',
+    (SELECT molfile FROM bridging_hydrogen WHERE id = 1), 'EXACT');
+SELECT sachem.remove_index('bridging_hydrogen');
+DROP TABLE bridging_hydrogen;
@@ -1,6 +1,5 @@
 package cz.iocb.sachem.fingerprint;
 
-import java.util.HashMap;
 import java.util.Map;
 import java.util.Set;
 import cz.iocb.sachem.molecule.Molecule;
@@ -9,10 +8,8 @@ import cz.iocb.sachem.molecule.Molecule;
 
 public class AtomFingerprint extends Fingerprint
 {
-    public static final Map<Integer, Integer> getFingerprint(Molecule molecule, Map<Integer, Set<Integer>> info)
+    public static final void getFingerprint(Molecule molecule, IntIntMap fp, Map<Integer, Set<Integer>> info)
     {
-        Map<Integer, Integer> fp = new HashMap<Integer, Integer>();
-
         for(int i = 0; i < molecule.getAtomCount(); i++)
         {
             int hsh = molecule.getAtomNumber(i);
@@ -25,7 +22,5 @@ public class AtomFingerprint extends Fingerprint
             if(info != null)
                 setInfo(info, hsh, i);
         }
-
-        return fp;
     }
 }
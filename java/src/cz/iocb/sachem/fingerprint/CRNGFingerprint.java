@@ -2,19 +2,25 @@ package cz.iocb.sachem.fingerprint;
 
 import java.io.IOException;
 import java.io.ObjectInputStream;
-import java.util.HashMap;
-import java.util.List;
 import java.util.Map;
 import java.util.Set;
 import cz.iocb.sachem.molecule.BinaryMolecule;
-import cz.iocb.sachem.molecule.Isomorphism;
-import cz.iocb.sachem.molecule.Molecule;
+import cz.iocb.sachem.molecule.ChargeMode;
+import cz.iocb.sachem.molecule.IsotopeMode;
+import cz.iocb.sachem.molecule.NativeIsomorphism;
+import cz.iocb.sachem.molecule.NativeIsomorphismSet;
+import cz.iocb.sachem.molecule.RadicalMode;
+import cz.iocb.sachem.molecule.SearchMode;
+import cz.iocb.sachem.molecule.StereoMode;
 
 
 
 public class CRNGFingerprint extends Fingerprint
 {
-    private static final Isomorphism[] patterns;
+    private static final int matchLimit = 256;
+    private static final NativeIsomorphism[] patterns;
+    private static final ThreadLocal<NativeIsomorphismSet> patternSets;
+    private static final ThreadLocal<NativeIsomorphism[]> patternForks;
 
 
     static
@@ -22,10 +28,15 @@ public class CRNGFingerprint extends Fingerprint
         try(ObjectInputStream in = new ObjectInputStream(CRNGFingerprint.class.getResourceAsStream("/patterns.bin")))
         {
             byte[][] molecules = (byte[][]) in.readObject();
-            patterns = new Isomorphism[molecules.length];
+            patterns = new NativeIsomorphism[molecules.length];
 
             for(int i = 0; i < molecules.length; i++)
-                patterns[i] = new Isomorphism(new BinaryMolecule(molecules[i]));
+                patterns[i] = new NativeIsomorphism(molecules[i], null, SearchMode.SUBSTRUCTURE, ChargeMode.IGNORE,
+                        IsotopeMode.IGNORE, RadicalMode.IGNORE, StereoMode.IGNORE);
+
+            NativeIsomorphismSet patternSet = new NativeIsomorphismSet(patterns);
+            patternSets = ThreadLocal.withInitial(patternSet::fork);
+            patternForks = ThreadLocal.withInitial(() -> new NativeIsomorphism[patterns.length]);
         }
         catch(IOException | ClassNotFoundException e)
         {
@@ -34,27 +45,30 @@ public class CRNGFingerprint extends Fingerprint
     }
 
 
-    public static final Map<Integer, Integer> getFingerprint(Molecule molecule, Map<Integer, Set<Integer>> info)
+    public static final void getFingerprint(BinaryMolecule molecule, IntIntMap fp, Map<Integer, Set<Integer>> info)
     {
-        Map<Integer, Integer> fp = new HashMap<Integer, Integer>();
+        // all patterns are matched against a single native decoding of the molecule
+        int[] counts = new int[patterns.length];
+        patternSets.get().matchAll(molecule.getData(), 0, matchLimit, counts);
+
+        // the forks of the patterns are kept per thread, each is created when its pattern matches for the first time
+        NativeIsomorphism[] forks = info != null ? patternForks.get() : null;
 
         for(int i = 0; i < patterns.length; i++)
         {
-            List<int[]> matches = patterns[i].matchAll(molecule, 256);
-
-            if(matches.size() == 0)
+            if(counts[i] == 0)
                 continue;
 
-            setFp(fp, i, matches.size());
+            setFp(fp, i, counts[i]);
 
             if(info != null)
             {
-                for(int[] match : matches)
-                    for(int atom : match)
-                        setInfo(info, i, atom);
+                if(forks[i] == null)
+                    forks[i] = patterns[i].fork();
+
+                for(int atom : forks[i].matchAll(molecule.getData(), 0, matchLimit))
+                    setInfo(info, i, atom);
             }
         }
-
-        return fp;
     }
 }
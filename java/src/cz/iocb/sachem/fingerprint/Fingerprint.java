@@ -1,5 +1,6 @@
 package cz.iocb.sachem.fingerprint;
 
+import java.util.Arrays;
 import java.util.Collections;
 import java.util.HashSet;
 import java.util.List;
@@ -11,25 +12,15 @@ import cz.iocb.sachem.molecule.Molecule;
 
 public abstract class Fingerprint
 {
-    protected static final void setFp(Map<Integer, Integer> fp, int hash)
+    protected static final void setFp(IntIntMap fp, int hash)
     {
-        Integer value = fp.get(hash);
-
-        if(value == null)
-            fp.put(hash, 1);
-        else
-            fp.put(hash, value + 1);
+        fp.add(hash, 1);
     }
 
 
-    protected static final void setFp(Map<Integer, Integer> fp, int hash, int size)
+    protected static final void setFp(IntIntMap fp, int hash, int size)
     {
-        Integer value = fp.get(hash);
-
-        if(value == null)
-            fp.put(hash, size);
-        else
-            fp.put(hash, value + size);
+        fp.add(hash, size);
     }
 
 
@@ -107,6 +98,25 @@ public abstract class Fingerprint
     }
 
 
+    protected static final int hash(int a, int b, int[] l, int length)
+    {
+        // sort the values as unsigned ones
+        for(int i = 0; i < length; i++)
+            l[i] ^= Integer.MIN_VALUE;
+
+        Arrays.sort(l, 0, length);
+
+        int seed = 0;
+        seed = updateSeed(a, seed);
+        seed = updateSeed(b, seed);
+
+        for(int i = 0; i < length; i++)
+            seed = updateSeed(l[i] ^ Integer.MIN_VALUE, seed);
+
+        return seed;
+    }
+
+
     protected static final int updateSeed(int x, int seed)
     {
         long xl = Integer.toUnsignedLong(x);
@@ -1,10 +1,7 @@
 package cz.iocb.sachem.fingerprint;
 
 import java.util.HashMap;
-import java.util.HashSet;
-import java.util.List;
 import java.util.Map;
-import java.util.Map.Entry;
 import java.util.Set;
 import cz.iocb.sachem.molecule.BinaryMolecule;
 import cz.iocb.sachem.molecule.Molecule;
@@ -13,13 +10,26 @@ import cz.iocb.sachem.molecule.Molecule;
 
 public class IOCBFingerprint extends Fingerprint
 {
-    private static final void processElements(Map<Integer, Integer> var, Map<Integer, Set<Integer>> vari, int n,
-            Set<Integer> fp, int maxFeatLogCount, boolean forQuery, Map<Integer, Set<Integer>> info)
+    private static final class Buffers
     {
-        for(Entry<Integer, Integer> i : var.entrySet())
+        private final IntIntMap counts = new IntIntMap();
+        private final IntSet fp = new IntSet(1024);
+    }
+
+
+    private static final ThreadLocal<Buffers> buffers = ThreadLocal.withInitial(Buffers::new);
+
+
+    static final void processElements(IntIntMap var, Map<Integer, Set<Integer>> vari, int n, IntSet fp,
+            int maxFeatLogCount, boolean forQuery, Map<Integer, Set<Integer>> info)
+    {
+        for(int slot = 0; slot < var.slots(); slot++)
         {
-            int h = i.getKey();
-            int cnt = i.getValue();
+            if(!var.isUsed(slot))
+                continue;
+
+            int h = var.key(slot);
+            int cnt = var.value(slot);
 
             if(forQuery)
             {
@@ -47,43 +57,51 @@ public class IOCBFingerprint extends Fingerprint
                 }
             }
         }
+
+        var.clear();
     }
 
 
-    public static final Set<Integer> getSubstructureFingerprint(Molecule molecule, int graphSize, int maxFeatLogCount,
+    public static final int[] getSubstructureFingerprint(BinaryMolecule molecule, int graphSize, int maxFeatLogCount,
             boolean forQuery, Map<Integer, Set<Integer>> info)
     {
-        Set<Integer> fp = new HashSet<Integer>();
+        // the counts and the bit set are reused by the following molecules of the thread
+        Buffers buffers = IOCBFingerprint.buffers.get();
+        IntIntMap counts = buffers.counts;
+        IntSet fp = buffers.fp;
+
+        counts.clear();
+        fp.clear();
 
         Map<Integer, Set<Integer>> sgi = info != null ? new HashMap<Integer, Set<Integer>>() : null;
-        Map<Integer, Integer> sg = SGFingerprint.getFingerprint(molecule, 0, graphSize, forQuery, sgi);
-        processElements(sg, sgi, 1, fp, maxFeatLogCount, forQuery, info);
+        SGFingerprint.getFingerprint(molecule, 0, graphSize, forQuery, counts, sgi);
+        processElements(counts, sgi, 1, fp, maxFeatLogCount, forQuery, info);
 
         Map<Integer, Set<Integer>> crngi = info != null ? new HashMap<Integer, Set<Integer>>() : null;
-        Map<Integer, Integer> crng = CRNGFingerprint.getFingerprint(molecule, crngi);
-        processElements(crng, crngi, 2, fp, maxFeatLogCount, forQuery, info);
+        CRNGFingerprint.getFingerprint(molecule, counts, crngi);
+        processElements(counts, crngi, 2, fp, maxFeatLogCount, forQuery, info);
 
         Map<Integer, Set<Integer>> atomi = info != null ? new HashMap<Integer, Set<Integer>>() : null;
-        Map<Integer, Integer> atom = AtomFingerprint.getFingerprint(molecule, atomi);
-        processElements(atom, atomi, 3, fp, maxFeatLogCount, forQuery, info);
+        AtomFingerprint.getFingerprint(molecule, counts, atomi);
+        processElements(counts, atomi, 3, fp, maxFeatLogCount, forQuery, info);
 
-        return fp;
+        return fp.toArray();
     }
 
 
-    public static Set<Integer> getSubstructureFingerprint(BinaryMolecule molecule)
+    public static int[] getSubstructureFingerprint(BinaryMolecule molecule)
     {
         return getSubstructureFingerprint(molecule, 7, 5, false, null);
     }
 
 
-    public static Set<Integer> getSubstructureFingerprint(BinaryMolecule molecule, Map<Integer, Set<Integer>> info)
+    public static int[] getSubstructureFingerprint(BinaryMolecule molecule, Map<Integer, Set<Integer>> info)
     {
         return getSubstructureFingerprint(molecule, 7, 5, true, info);
     }
 
 
-    public static final List<List<Integer>> getSimilarityFingerprint(Molecule molecule, int circSize)
+    public static final int[][] getSimilarityFingerprint(Molecule molecule, int circSize)
     {
         return RCFingerprint.getFingerprint(molecule, 0, circSize);
     }
@@ -0,0 +1,142 @@
+package cz.iocb.sachem.fingerprint;
+
+import java.util.Arrays;
+
+
+
+public final class IntIntMap
+{
+    private int[] keys;
+    private int[] values;
+    private boolean[] used;
+    private int size;
+
+
+    public IntIntMap()
+    {
+        this(64);
+    }
+
+
+    public IntIntMap(int capacity)
+    {
+        int slots = Integer.highestOneBit(Math.max(capacity, 4) - 1) << 2;
+
+        keys = new int[slots];
+        values = new int[slots];
+        used = new boolean[slots];
+    }
+
+
+    private static int slot(int key, int mask)
+    {
+        int hash = key * 0x9e3779b9;
+        return (hash ^ hash >>> 16) & mask;
+    }
+
+
+    public void add(int key, int delta)
+    {
+        int mask = keys.length - 1;
+        int slot = slot(key, mask);
+
+        while(used[slot])
+        {
+            if(keys[slot] == key)
+            {
+                values[slot] += delta;
+                return;
+            }
+
+            slot = slot + 1 & mask;
+        }
+
+        used[slot] = true;
+        keys[slot] = key;
+        values[slot] = delta;
+
+        if(++size * 2 > keys.length)
+            grow();
+    }
+
+
+    public int get(int key)
+    {
+        int mask = keys.length - 1;
+
+        for(int slot = slot(key, mask); used[slot]; slot = slot + 1 & mask)
+            if(keys[slot] == key)
+                return values[slot];
+
+        return 0;
+    }
+
+
+    private void grow()
+    {
+        int[] oldKeys = keys;
+        int[] oldValues = values;
+        boolean[] oldUsed = used;
+
+        keys = new int[oldKeys.length * 2];
+        values = new int[oldKeys.length * 2];
+        used = new boolean[oldKeys.length * 2];
+
+        int mask = keys.length - 1;
+
+        for(int i = 0; i < oldKeys.length; i++)
+        {
+            if(!oldUsed[i])
+                continue;
+
+            int slot = slot(oldKeys[i], mask);
+
+            while(used[slot])
+                slot = slot + 1 & mask;
+
+            used[slot] = true;
+            keys[slot] = oldKeys[i];
+            values[slot] = oldValues[i];
+        }
+    }
+
+
+    public void clear()
+    {
+        if(size != 0)
+            Arrays.fill(used, false);
+
+        size = 0;
+    }
+
+
+    public int size()
+    {
+        return size;
+    }
+
+
+    // entries are iterated by their slots, unused slots are skipped by the caller
+    public int slots()
+    {
+        return keys.length;
+    }
+
+
+    public boolean isUsed(int slot)
+    {
+        return used[slot];
+    }
+
+
+    public int key(int slot)
+    {
+        return keys[slot];
+    }
+
+
+    public int value(int slot)
+    {
+        return values[slot];
+    }
+}
@@ -0,0 +1,125 @@
+package cz.iocb.sachem.fingerprint;
+
+import java.util.Arrays;
+
+
+
+public final class IntSet
+{
+    private int[] keys;
+    private boolean[] used;
+    private int size;
+
+
+    public IntSet()
+    {
+        this(64);
+    }
+
+
+    public IntSet(int capacity)
+    {
+        int slots = Integer.highestOneBit(Math.max(capacity, 4) - 1) << 2;
+
+        keys = new int[slots];
+        used = new boolean[slots];
+    }
+
+
+    private static int slot(int key, int mask)
+    {
+        int hash = key * 0x9e3779b9;
+        return (hash ^ hash >>> 16) & mask;
+    }
+
+
+    public boolean add(int key)
+    {
+        int mask = keys.length - 1;
+        int slot = slot(key, mask);
+
+        while(used[slot])
+        {
+            if(keys[slot] == key)
+                return false;
+
+            slot = slot + 1 & mask;
+        }
+
+        used[slot] = true;
+        keys[slot] = key;
+
+        if(++size * 2 > keys.length)
+            grow();
+
+        return true;
+    }
+
+
+    public boolean contains(int key)
+    {
+        int mask = keys.length - 1;
+
+        for(int slot = slot(key, mask); used[slot]; slot = slot + 1 & mask)
+            if(keys[slot] == key)
+                return true;
+
+        return false;
+    }
+
+
+    private void grow()
+    {
+        int[] oldKeys = keys;
+        boolean[] oldUsed = used;
+
+        keys = new int[oldKeys.length * 2];
+        used = new boolean[oldKeys.length * 2];
+
+        int mask = keys.length - 1;
+
+        for(int i = 0; i < oldKeys.length; i++)
+        {
+            if(!oldUsed[i])
+                continue;
+
+            int slot = slot(oldKeys[i], mask);
+
+            while(used[slot])
+                slot = slot + 1 & mask;
+
+            used[slot] = true;
+            keys[slot] = oldKeys[i];
+        }
+    }
+
+
+    public void clear()
+    {
+        if(size != 0)
+            Arrays.fill(used, false);
+
+        size = 0;
+    }
+
+
+    public int size()
+    {
+        return size;
+    }
+
+
+    // the values are returned in ascending order
+    public int[] toArray()
+    {
+        int[] array = new int[size];
+
+        for(int i = 0, j = 0; i < keys.length; i++)
+            if(used[i])
+                array[j++] = keys[i];
+
+        Arrays.sort(array);
+
+        return array;
+    }
+}
@@ -1,107 +1,126 @@
 package cz.iocb.sachem.fingerprint;
 
 import java.util.ArrayList;
-import java.util.Collections;
-import java.util.HashMap;
-import java.util.HashSet;
+import java.util.Arrays;
 import java.util.List;
-import java.util.Map;
-import java.util.Set;
 import cz.iocb.sachem.molecule.Molecule;
 
 
 
 public class RCFingerprint extends Fingerprint
 {
-    private final static class AtomDesc
-    {
-        private final int hash;
-        private final Set<Integer> cover;
+    private static final int[] emptyCover = new int[0];
 
-        private AtomDesc(int hash)
-        {
-            this.hash = hash;
-            this.cover = new HashSet<Integer>();
-        }
 
-        private AtomDesc(int hash, Set<Integer> cover)
-        {
-            this.hash = hash;
-            this.cover = cover;
-        }
-    }
+    public static final int[][] getFingerprint(Molecule molecule, int minRadius, int maxRadius)
+    {
+        int atomCount = molecule.getAtomCount();
+        List<int[]> fp = new ArrayList<int[]>(maxRadius - minRadius + 1);
 
+        // an atom is described by its hash and by the sorted ids of the bonds covered by it
+        int[] hashes = new int[atomCount];
+        int[][] covers = new int[atomCount][];
+        int[] newHashes = new int[atomCount];
+        int[][] newCovers = new int[atomCount][];
 
-    public static final List<List<Integer>> getFingerprint(Molecule molecule, int minRadius, int maxRadius)
-    {
-        Map<Integer, AtomDesc> desc = new HashMap<Integer, AtomDesc>();
-        List<List<Integer>> fp = new ArrayList<List<Integer>>(maxRadius - minRadius + 1);
+        int[] level = new int[atomCount];
+        int levelSize = 0;
 
+        int[] hs = new int[16];
+        int[] cover = new int[16];
 
-        if(minRadius == 0)
-            fp.add(new ArrayList<Integer>(molecule.getAtomCount()));
 
-        for(int a = 0; a < molecule.getAtomCount(); a++)
+        for(int a = 0; a < atomCount; a++)
         {
             if(molecule.getAtomNumber(a) == Molecule.AtomType.H /*|| molecule.isAtomPseudo(a)*/)
                 continue;
 
-            AtomDesc atomDesc = new AtomDesc(hashAtom(molecule, a));
-            desc.put(a, atomDesc);
+            hashes[a] = hashAtom(molecule, a);
+            covers[a] = emptyCover;
 
             if(minRadius == 0)
-                fp.get(fp.size() - 1).add(atomDesc.hash);
+                level[levelSize++] = hashes[a];
         }
 
+        if(minRadius == 0)
+            fp.add(sortedLevel(level, levelSize));
+
 
         for(int radius = 1; radius <= maxRadius; radius++)
         {
-            Map<Integer, AtomDesc> newdesc = new HashMap<Integer, AtomDesc>();
-
-            if(radius >= minRadius)
-                fp.add(new ArrayList<Integer>(molecule.getAtomCount()));
-
+            levelSize = 0;
 
-            for(int i = 0; i < molecule.getAtomCount(); i++)
+            for(int i = 0; i < atomCount; i++)
             {
-                if(!desc.containsKey(i))
+                if(covers[i] == null)
                     continue;
 
-                List<Integer> hs = new ArrayList<Integer>(molecule.getAtomCount());
-                Set<Integer> newcover = new HashSet<Integer>();
+                int[] bondedAtoms = molecule.getBondedAtoms(i);
+                int hsSize = 0;
+                int coverSize = 0;
 
-                for(int a : molecule.getBondedAtoms(i))
+                for(int a : bondedAtoms)
                 {
                     int b = molecule.getBond(i, a);
 
-                    if(!desc.containsKey(a) /*|| molecule.isQueryBond(b)*/)
+                    if(covers[a] == null /*|| molecule.isQueryBond(b)*/)
                         continue;
 
-                    newcover.add(b);
-                    newcover.addAll(desc.get(a).cover);
-                    hs.add(hash(hashBond(molecule, b), desc.get(a).hash));
+                    if(coverSize + covers[a].length + 1 > cover.length)
+                        cover = Arrays.copyOf(cover, 2 * (coverSize + covers[a].length + 1));
+
+                    cover[coverSize++] = b;
+                    System.arraycopy(covers[a], 0, cover, coverSize, covers[a].length);
+                    coverSize += covers[a].length;
+
+                    if(hsSize == hs.length)
+                        hs = Arrays.copyOf(hs, 2 * hs.length);
+
+                    hs[hsSize++] = hash(hashBond(molecule, b), hashes[a]);
                 }
 
+                Arrays.sort(cover, 0, coverSize);
+                int newCoverSize = 0;
 
-                if(!newcover.equals(desc.get(i).cover))
-                {
-                    AtomDesc atomDesc = new AtomDesc(hash(desc.get(i).hash, newcover.size(), hs), newcover);
+                for(int c = 0; c < coverSize; c++)
+                    if(c == 0 || cover[c] != cover[c - 1])
+                        cover[newCoverSize++] = cover[c];
 
-                    newdesc.put(i, atomDesc);
+
+                if(!Arrays.equals(cover, 0, newCoverSize, covers[i], 0, covers[i].length))
+                {
+                    newHashes[i] = hash(hashes[i], newCoverSize, hs, hsSize);
+                    newCovers[i] = Arrays.copyOf(cover, newCoverSize);
 
                     if(radius >= minRadius)
-                        fp.get(fp.size() - 1).add(atomDesc.hash);
+                        level[levelSize++] = newHashes[i];
                 }
             }
 
-            desc = newdesc;
+            if(radius >= minRadius)
+                fp.add(sortedLevel(level, levelSize));
+
+
+            int[] hashesSwap = hashes;
+            hashes = newHashes;
+            newHashes = hashesSwap;
+
+            int[][] coversSwap = covers;
+            covers = newCovers;
+            newCovers = coversSwap;
+
+            Arrays.fill(newCovers, null);
         }
 
 
-        for(List<Integer> list : fp)
-            Collections.sort(list);
+        return fp.toArray(new int[fp.size()][]);
+    }
 
 
-        return fp;
+    private static final int[] sortedLevel(int[] level, int size)
+    {
+        int[] sorted = Arrays.copyOf(level, size);
+        Arrays.sort(sorted);
+        return sorted;
     }
 }
@@ -10,9 +10,8 @@
  */
 package cz.iocb.sachem.fingerprint;
 
-import java.util.ArrayDeque;
 import java.util.ArrayList;
-import java.util.Collection;
+import java.util.Arrays;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
@@ -37,14 +36,16 @@ public class SGFingerprint extends Fingerprint
     }
 
 
-    private static final Integer hashSubmolecule(Collection<Integer> bondIds, Molecule molecule)
+    private static final Integer hashSubmolecule(int[] bondIds, int bondCount, Molecule molecule)
     {
         Map<Integer, List<Integer>> preatoms = new HashMap<Integer, List<Integer>>();
 
         int max = 1;
 
-        for(int bid : bondIds)
+        for(int b = 0; b < bondCount; b++)
         {
+            int bid = bondIds[b];
+
             for(int i = 0; i < 2; i++)
             {
                 List<Integer> list = preatoms.get(molecule.getBondAtom(bid, i));
@@ -225,168 +226,225 @@ public class SGFingerprint extends Fingerprint
     }
 
 
-    private static final List<List<Integer>> getNeighborLists(Molecule molecule)
+    private static final int[][] getNeighborLists(Molecule molecule)
     {
-        List<List<Integer>> nbrs = new ArrayList<List<Integer>>(molecule.getBondCount());
-
-        for(int i = 0; i < molecule.getBondCount(); i++)
-            nbrs.add(new ArrayList<Integer>());
+        int bondCount = molecule.getBondCount();
+        int[] sizes = new int[bondCount];
+        int[][] nbrs = null;
 
 
-        // create a list of neighbors for each bond
-        for(int i = 0; i < molecule.getAtomCount(); i++)
+        // create a list of neighbors for each bond, the first pass only counts them
+        for(int pass = 0; pass < 2; pass++)
         {
-            if(molecule.getAtomNumber(i) <= Molecule.AtomType.H)
-                continue;
-
-            int[] bondedAtoms = molecule.getBondedAtoms(i);
-
-            for(int l : bondedAtoms)
+            for(int i = 0; i < molecule.getAtomCount(); i++)
             {
-                if(molecule.getAtomNumber(l) <= Molecule.AtomType.H)
+                if(molecule.getAtomNumber(i) <= Molecule.AtomType.H)
                     continue;
 
-                int bid1 = molecule.getBond(i, l);
-
-                if(molecule.getBondType(bid1) > Molecule.BondType.AROMATIC)
-                    continue;
+                int[] bondedAtoms = molecule.getBondedAtoms(i);
 
-                for(int k : bondedAtoms)
+                for(int l : bondedAtoms)
                 {
-                    if(molecule.getAtomNumber(k) <= Molecule.AtomType.H)
+                    if(molecule.getAtomNumber(l) <= Molecule.AtomType.H)
                         continue;
 
-                    int bid2 = molecule.getBond(i, k);
+                    int bid1 = molecule.getBond(i, l);
 
-                    if(molecule.getBondType(bid2) > Molecule.BondType.AROMATIC)
+                    if(molecule.getBondType(bid1) > Molecule.BondType.AROMATIC)
                         continue;
 
-                    if(bid1 != bid2)
-                        nbrs.get(bid1).add(bid2);
+                    for(int k : bondedAtoms)
+                    {
+                        if(molecule.getAtomNumber(k) <= Molecule.AtomType.H)
+                            continue;
+
+                        int bid2 = molecule.getBond(i, k);
+
+                        if(molecule.getBondType(bid2) > Molecule.BondType.AROMATIC)
+                            continue;
+
+                        if(bid1 != bid2)
+                        {
+                            if(nbrs == null)
+                                sizes[bid1]++;
+                            else
+                                nbrs[bid1][sizes[bid1]++] = bid2;
+                        }
+                    }
                 }
             }
+
+            if(nbrs == null)
+            {
+                nbrs = new int[bondCount][];
+
+                for(int b = 0; b < bondCount; b++)
+                    nbrs[b] = new int[sizes[b]];
+
+                Arrays.fill(sizes, 0);
+            }
         }
 
         return nbrs;
     }
 
 
-    private static final void recurseWalkRange(List<List<Integer>> nbrs, List<Integer> spath, ArrayDeque<Integer> cands,
-            int lowerLen, int upperLen, boolean[] forbidden, List<List<Integer>> res)
+    private static final void addSubgraph(Molecule molecule, int[] path, int length, IntIntMap fp,
+            Map<Integer, Set<Integer>> info)
     {
-        int nsize = spath.size();
-
-        if(nsize >= lowerLen && nsize <= upperLen)
-            res.add(spath);
-
-        // end case for recursion
-        if(nsize >= upperLen)
-            return;
-
+        Integer hash = hashSubmolecule(path, length, molecule);
 
-        // we  have the candidates that can be used to add to the existing path try extending the subgraphs
-        while(cands.size() != 0)
+        if(hash != null)
         {
-            int next = cands.removeLast(); // start with the last one in the candidate list
+            setFp(fp, hash);
 
-            if(!forbidden[next])
+            if(info != null)
             {
-                // this bond should not appear in the later subgraphs
-                forbidden[next] = true;
-
-                // update a local stack before the next recursive call
-                ArrayDeque<Integer> tstack = new ArrayDeque<Integer>(cands);
-
-                for(int bid : nbrs.get(next))
-                    if(!forbidden[bid])
-                        tstack.add(bid);
-
-                ArrayList<Integer> tpath = new ArrayList<Integer>(spath);
-                tpath.add(next);
-
-                recurseWalkRange(nbrs, tpath, tstack, lowerLen, upperLen, forbidden.clone(), res);
+                for(int i = 0; i < length; i++)
+                {
+                    setInfo(info, hash, molecule.getBondAtom(path[i], 0));
+                    setInfo(info, hash, molecule.getBondAtom(path[i], 1));
+                }
             }
         }
     }
 
 
-    private static final List<List<Integer>> findSubgraphs(Molecule molecule, int lowerLen, int upperLen,
-            int rootedAtAtom)
+    private static final class SubgraphWalk
     {
-        boolean[] forbidden = new boolean[molecule.getBondCount()];
+        private final Molecule molecule;
+        private final int[][] nbrs;
+        private final int lowerLen;
+        private final int upperLen;
+        private final IntIntMap fp;
+        private final Map<Integer, Set<Integer>> info;
+
+        // the current path and one frame of forbidden bits and candidates per path length
+        private final int[] path;
+        private final int words;
+        private final long[] forbidden;
+        private final int width;
+        private final int[] cands;
+
+        private SubgraphWalk(Molecule molecule, int lowerLen, int upperLen, IntIntMap fp,
+                Map<Integer, Set<Integer>> info)
+        {
+            this.molecule = molecule;
+            this.nbrs = getNeighborLists(molecule);
+            this.lowerLen = lowerLen;
+            this.upperLen = upperLen;
+            this.fp = fp;
+            this.info = info;
+
+            int maxLen = Math.max(upperLen, 1);
+            int maxNbrs = 1;
+
+            for(int[] list : nbrs)
+                maxNbrs = Math.max(maxNbrs, list.length);
+
+            // a frame holds the candidates inherited from the parent plus at most maxNbrs for each path bond
+            this.path = new int[maxLen + 1];
+            this.words = (molecule.getBondCount() >> 6) + 1;
+            this.forbidden = new long[(maxLen + 2) * words];
+            this.width = (maxLen + 1) * maxNbrs;
+            this.cands = new int[(maxLen + 1) * width];
+        }
 
-        List<List<Integer>> nbrs = getNeighborLists(molecule);
 
-        // start path at each bond
-        List<List<Integer>> res = new ArrayList<List<Integer>>();
+        private boolean isForbidden(int frame, int bid)
+        {
+            return (forbidden[frame + (bid >> 6)] & 1L << bid) != 0;
+        }
 
-        // start paths at each bond:
-        for(int i = 0; i < molecule.getBondCount(); i++)
+
+        private void recurseWalkRange(int nsize, int count)
         {
-            if(molecule.getBondType(i) > Molecule.BondType.AROMATIC)
-                continue;
+            if(nsize >= lowerLen && nsize <= upperLen)
+                addSubgraph(molecule, path, nsize, fp, info);
 
-            if(molecule.getAtomNumber(molecule.getBondAtom(i, 0)) <= Molecule.AtomType.H)
-                continue;
+            // end case for recursion
+            if(nsize >= upperLen)
+                return;
 
-            if(molecule.getAtomNumber(molecule.getBondAtom(i, 1)) <= Molecule.AtomType.H)
-                continue;
 
+            int frame = nsize * words;
+            int base = nsize * width;
 
-            // if we are only returning paths rooted at a particular atom, check now that this bond involves that atom:
-            if(rootedAtAtom >= 0 && molecule.getBondAtom(i, 0) != rootedAtAtom
-                    && molecule.getBondAtom(i, 1) != rootedAtAtom)
-                continue;
+            // we  have the candidates that can be used to add to the existing path try extending the subgraphs
+            while(count != 0)
+            {
+                int next = cands[base + --count]; // start with the last one in the candidate list
 
-            // do not come back to this bond in the later subgraphs
-            if(forbidden[i])
-                continue;
+                if(!isForbidden(frame, next))
+                {
+                    // this bond should not appear in the later subgraphs
+                    forbidden[frame + (next >> 6)] |= 1L << next;
+                    System.arraycopy(forbidden, frame, forbidden, frame + words, words);
 
-            forbidden[i] = true;
+                    // update a local stack before the next recursive call
+                    System.arraycopy(cands, base, cands, base + width, count);
+                    int tcount = count;
 
-            // start the recursive path building with the current bond
-            List<Integer> spath = new ArrayList<Integer>();
-            spath.add(i);
+                    for(int bid : nbrs[next])
+                        if(!isForbidden(frame, bid))
+                            cands[base + width + tcount++] = bid;
 
-            // neighbors of this bond are the next candidates
-            ArrayDeque<Integer> cands = new ArrayDeque<Integer>(nbrs.get(i));
+                    path[nsize] = next;
 
-            // now call the recursive function little bit different from the python version
-            // the result list of paths is passed as a reference, instead of on the fly appending
-            recurseWalkRange(nbrs, spath, cands, lowerLen, upperLen, forbidden.clone(), res);
+                    recurseWalkRange(nsize + 1, tcount);
+                }
+            }
         }
 
-        return res;
-    }
 
+        private void findSubgraphs(int rootedAtAtom)
+        {
+            // start paths at each bond:
+            for(int i = 0; i < molecule.getBondCount(); i++)
+            {
+                if(molecule.getBondType(i) > Molecule.BondType.AROMATIC)
+                    continue;
 
-    private static final void addMoleculeFingerprint(Molecule molecule, Map<Integer, Integer> fp, int minLen,
-            int maxLen, Map<Integer, Set<Integer>> info)
-    {
-        List<List<Integer>> allSGs = findSubgraphs(molecule, minLen, maxLen, -1);
+                if(molecule.getAtomNumber(molecule.getBondAtom(i, 0)) <= Molecule.AtomType.H)
+                    continue;
 
+                if(molecule.getAtomNumber(molecule.getBondAtom(i, 1)) <= Molecule.AtomType.H)
+                    continue;
 
-        for(List<Integer> i : allSGs)
-        {
-            Integer hash = hashSubmolecule(i, molecule);
 
-            if(hash != null)
-            {
-                setFp(fp, hash);
+                // if we are only returning paths rooted at a particular atom, check now that this bond involves
+                // that atom:
+                if(rootedAtAtom >= 0 && molecule.getBondAtom(i, 0) != rootedAtAtom
+                        && molecule.getBondAtom(i, 1) != rootedAtAtom)
+                    continue;
 
-                if(info != null)
-                {
-                    for(int b : i)
-                    {
-                        setInfo(info, hash, molecule.getBondAtom(b, 0));
-                        setInfo(info, hash, molecule.getBondAtom(b, 1));
-                    }
-                }
+                // do not come back to this bond in the later subgraphs
+                if(isForbidden(0, i))
+                    continue;
+
+                forbidden[i >> 6] |= 1L << i;
+                System.arraycopy(forbidden, 0, forbidden, words, words);
+
+                // start the recursive path building with the current bond
+                path[0] = i;
+
+                // neighbors of this bond are the next candidates
+                System.arraycopy(nbrs[i], 0, cands, width, nbrs[i].length);
+
+                // subgraphs are hashed as soon as they are found, instead of collecting them in a result list
+                recurseWalkRange(1, nbrs[i].length);
             }
         }
     }
 
 
+    private static final void addMoleculeFingerprint(Molecule molecule, IntIntMap fp, int minLen, int maxLen,
+            Map<Integer, Set<Integer>> info)
+    {
+        new SubgraphWalk(molecule, minLen, maxLen, fp, info).findSubgraphs(-1);
+    }
+
+
     private static final int fragmentWalk(Molecule molecule, int atom, boolean[] visitedAtoms, boolean[] visitedBonds,
             int visited)
     {
@@ -419,8 +477,8 @@ public class SGFingerprint extends Fingerprint
     }
 
 
-    public static final Map<Integer, Integer> getFingerprint(Molecule molecule, int minLen, int maxLen,
-            boolean forQuery, Map<Integer, Set<Integer>> info)
+    public static final void getFingerprint(Molecule molecule, int minLen, int maxLen, boolean forQuery, IntIntMap fp,
+            Map<Integer, Set<Integer>> info)
     {
         if(forQuery)
         {
@@ -444,9 +502,6 @@ public class SGFingerprint extends Fingerprint
         }
 
 
-        Map<Integer, Integer> fp = new HashMap<Integer, Integer>();
         addMoleculeFingerprint(molecule, fp, minLen, maxLen, info);
-
-        return fp;
     }
 }
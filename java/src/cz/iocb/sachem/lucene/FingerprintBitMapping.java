@@ -1,22 +1,108 @@
 package cz.iocb.sachem.lucene;
 
+import java.io.IOException;
+import java.util.Map;
+import org.apache.lucene.index.DirectoryReader;
+import org.apache.lucene.index.IndexReader;
+import org.apache.lucene.index.Term;
+import org.apache.lucene.util.BytesRef;
+
 
 
 public final class FingerprintBitMapping
 {
-    private static final char[] b64str = { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
+    // indexes committed without this user data entry use the legacy base64 terms
+    static final String formatKey = "fingerprint_terms";
+    static final String binaryFormat = "binary";
+
+    static final int binaryLength = Integer.BYTES;
+    static final int legacyLength = 6;
+
+    private static final byte[] b64str = { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
             'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',
             'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3', '4',
             '5', '6', '7', '8', '9', '+', '/' };
 
-    private final char[] buffer = new char[6];
+    private static final byte[] b64val = new byte[128];
+
+    static
+    {
+        for(int i = 0; i < b64str.length; i++)
+            b64val[b64str[i]] = (byte) i;
+    }
+
+    private final boolean binary;
+    private final BytesRef bytes;
+
+
+    public FingerprintBitMapping(IndexReader reader) throws IOException
+    {
+        if(reader instanceof DirectoryReader)
+            binary = isBinary(((DirectoryReader) reader).getIndexCommit().getUserData());
+        else
+            binary = true;
+
+        bytes = new BytesRef(new byte[binary ? binaryLength : legacyLength]);
+    }
+
+
+    static boolean isBinary(Map<String, String> userData)
+    {
+        return binaryFormat.equals(userData.get(formatKey));
+    }
+
+
+    static void bitAsBytes(int bit, byte[] buffer)
+    {
+        for(int i = 0; i < binaryLength; i++)
+            buffer[i] = (byte) (bit >>> 8 * (binaryLength - 1 - i));
+    }
 
 
-    public final String bitAsString(int bit)
+    // the returned term bytes are overwritten by the next call, so they can be used only for transient lookups
+    public final BytesRef bitAsBytes(int bit)
     {
-        for(int i = 0; i < 6; i++)
-            buffer[i] = b64str[bit >>> 6 * i & 0x3f];
+        if(binary)
+        {
+            bitAsBytes(bit, bytes.bytes);
+        }
+        else
+        {
+            for(int i = 0; i < legacyLength; i++)
+                bytes.bytes[i] = b64str[bit >>> 6 * i & 0x3f];
+        }
+
+        return bytes;
+    }
+
+
+    public final boolean isBit(BytesRef term)
+    {
+        return term.length == (binary ? binaryLength : legacyLength);
+    }
 
-        return new String(buffer);
+
+    public final int bytesAsBit(BytesRef term)
+    {
+        int bit = 0;
+
+        if(binary)
+        {
+            for(int i = 0; i < binaryLength; i++)
+                bit = bit << 8 | Byte.toUnsignedInt(term.bytes[term.offset + i]);
+        }
+        else
+        {
+            for(int i = 0; i < legacyLength; i++)
+                bit |= b64val[term.bytes[term.offset + i] & 0x7f] << 6 * i;
+        }
+
+        return bit;
+    }
+
+
+    public final Term bitAsTerm(String field, int bit)
+    {
+        return new Term(field, BytesRef.deepCopyOf(bitAsBytes(bit)));
     }
 }
@@ -0,0 +1,143 @@
+package cz.iocb.sachem.lucene;
+
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+import org.apache.lucene.index.IndexReader;
+import org.apache.lucene.index.LeafReaderContext;
+import org.apache.lucene.index.PostingsEnum;
+import org.apache.lucene.index.Terms;
+import org.apache.lucene.index.TermsEnum;
+import org.apache.lucene.search.DocIdSetIterator;
+import org.apache.lucene.util.BytesRef;
+import cz.iocb.sachem.fingerprint.IntIntMap;
+
+
+
+final class FingerprintStatistics
+{
+    static final int defaultSampleSize = 1024;
+
+    private final int docCount;
+    private final int sampleSize;
+    private final IntIntMap docFreqs;
+
+    // for each bit present in a sampled document, a bit set of the sampled documents containing it
+    private final IntIntMap sampleIndices;
+    private final List<long[]> samples;
+
+
+    FingerprintStatistics(IndexReader reader, String field, int maxSampleSize) throws IOException
+    {
+        FingerprintBitMapping mapping = new FingerprintBitMapping(reader);
+
+        docCount = reader.maxDoc();
+        sampleSize = Math.min(maxSampleSize, docCount);
+        docFreqs = new IntIntMap(1024);
+        sampleIndices = new IntIntMap(1024);
+        samples = new ArrayList<long[]>();
+
+        // the sampled documents are spread evenly over the whole index
+        int stride = sampleSize > 0 ? docCount / sampleSize : 0;
+
+        for(LeafReaderContext context : reader.leaves())
+        {
+            Terms terms = context.reader().terms(field);
+
+            if(terms == null)
+                continue;
+
+            // the range of the samples falling into this segment
+            int docBase = context.docBase;
+            int first = 0;
+            int last = 0;
+
+            if(sampleSize > 0)
+            {
+                first = (docBase + stride - 1) / stride;
+                last = Math.min(sampleSize, (docBase + context.reader().maxDoc() + stride - 1) / stride);
+            }
+
+            // a single pass over the terms dictionary replaces a seek per query bit
+            TermsEnum iterator = terms.iterator();
+            PostingsEnum postings = null;
+            BytesRef term;
+
+            while((term = iterator.next()) != null)
+            {
+                if(!mapping.isBit(term))
+                    continue;
+
+                int bit = mapping.bytesAsBit(term);
+                docFreqs.add(bit, iterator.docFreq());
+
+                if(first >= last)
+                    continue;
+
+                postings = iterator.postings(postings, PostingsEnum.NONE);
+
+                for(int sample = first; sample < last;)
+                {
+                    int doc = postings.advance(sample * stride - docBase);
+
+                    if(doc == DocIdSetIterator.NO_MORE_DOCS)
+                        break;
+
+                    int next = (doc + docBase + stride - 1) / stride;
+
+                    if(next >= last)
+                        break;
+
+                    if(next * stride == doc + docBase)
+                    {
+                        sampleSet(bit)[next >> 6] |= 1L << next;
+                        next++;
+                    }
+
+                    sample = next;
+                }
+            }
+        }
+    }
+
+
+    private long[] sampleSet(int bit)
+    {
+        int index = sampleIndices.get(bit);
+
+        if(index == 0)
+        {
+            samples.add(new long[(sampleSize + 63) / 64]);
+            sampleIndices.add(bit, samples.size());
+            index = samples.size();
+        }
+
+        return samples.get(index - 1);
+    }
+
+
+    int docCount()
+    {
+        return docCount;
+    }
+
+
+    int docFreq(int bit)
+    {
+        return docFreqs.get(bit);
+    }
+
+
+    int sampleSize()
+    {
+        return sampleSize;
+    }
+
+
+    // returns null if the bit is not present in any sampled document
+    long[] samples(int bit)
+    {
+        int index = sampleIndices.get(bit);
+        return index == 0 ? null : samples.get(index - 1);
+    }
+}
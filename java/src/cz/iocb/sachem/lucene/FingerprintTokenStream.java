@@ -1,35 +1,37 @@
 package cz.iocb.sachem.lucene;
 
 import java.io.IOException;
-import java.util.Collection;
-import java.util.Iterator;
 import org.apache.lucene.analysis.TokenStream;
-import org.apache.lucene.analysis.tokenattributes.CharTermAttribute;
+import org.apache.lucene.analysis.tokenattributes.BytesTermAttribute;
+import org.apache.lucene.util.BytesRef;
 
 
 
 public class FingerprintTokenStream extends TokenStream
 {
-    private final CharTermAttribute charTermAttribute = addAttribute(CharTermAttribute.class);
-    private final FingerprintBitMapping mapping = new FingerprintBitMapping();
-    private Iterator<Integer> iterator;
+    private final BytesTermAttribute bytesTermAttribute = addAttribute(BytesTermAttribute.class);
+    private final BytesRef term = new BytesRef(new byte[FingerprintBitMapping.binaryLength]);
+    private final int[] fp;
+    private int position = 0;
 
 
-    public FingerprintTokenStream(Collection<Integer> fp)
+    public FingerprintTokenStream(int[] fp)
     {
-        iterator = fp.iterator();
+        this.fp = fp;
     }
 
 
     @Override
     public boolean incrementToken() throws IOException
     {
-        charTermAttribute.setEmpty();
+        clearAttributes();
 
-        if(!iterator.hasNext())
+        if(position == fp.length)
             return false;
 
-        charTermAttribute.append(mapping.bitAsString(iterator.next()));
+        // the bits are indexed as 4-byte binary terms
+        FingerprintBitMapping.bitAsBytes(fp[position++], term.bytes);
+        bytesTermAttribute.setBytesRef(term);
 
         return true;
     }
@@ -0,0 +1,82 @@
+package cz.iocb.sachem.lucene;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+
+
+
+final class FoldedFingerprint
+{
+    static final int size = 2048;
+    static final int length = size / Byte.SIZE;
+
+    private static final int shift = Integer.SIZE - Integer.numberOfTrailingZeros(size);
+    private static final VarHandle words = MethodHandles.byteArrayViewVarHandle(long[].class, ByteOrder.LITTLE_ENDIAN);
+
+    // the byte offsets and the values of the non-zero words of the query
+    private final int[] offsets;
+    private final long[] masks;
+
+
+    FoldedFingerprint(int[] fp)
+    {
+        long[] folded = new long[size / Long.SIZE];
+
+        for(int bit : fp)
+        {
+            int position = fold(bit);
+            folded[position >> 6] |= 1L << position;
+        }
+
+        int count = 0;
+
+        for(long word : folded)
+            if(word != 0)
+                count++;
+
+        offsets = new int[count];
+        masks = new long[count];
+
+        for(int i = 0, w = 0; w < folded.length; w++)
+        {
+            if(folded[w] != 0)
+            {
+                offsets[i] = w * Long.BYTES;
+                masks[i++] = folded[w];
+            }
+        }
+    }
+
+
+    private static int fold(int bit)
+    {
+        // the fingerprint bits are hashes already, the multiplication only spreads their high bits
+        return bit * 0x9e3779b9 >>> shift;
+    }
+
+
+    static byte[] asBytes(int[] fp)
+    {
+        byte[] data = new byte[length];
+
+        for(int bit : fp)
+        {
+            int position = fold(bit);
+            data[position >> 3] |= 1 << (position & 7);
+        }
+
+        return data;
+    }
+
+
+    // a target passes unless it misses some of the query bits; the test touches only the non-zero query words
+    boolean isSubsetOf(byte[] data, int offset)
+    {
+        for(int i = 0; i < masks.length; i++)
+            if(((long) words.get(data, offset + offsets[i]) & masks[i]) != masks[i])
+                return false;
+
+        return true;
+    }
+}
@@ -2,28 +2,33 @@ package cz.iocb.sachem.lucene;
 
 import java.io.IOException;
 import java.nio.file.Paths;
-import java.util.HashSet;
-import java.util.List;
-import java.util.Set;
+import java.util.Map;
 import java.util.concurrent.ArrayBlockingQueue;
 import org.apache.lucene.document.BinaryDocValuesField;
 import org.apache.lucene.document.Document;
+import org.apache.lucene.document.Field;
+import org.apache.lucene.document.FieldType;
 import org.apache.lucene.document.IntPoint;
 import org.apache.lucene.document.NumericDocValuesField;
 import org.apache.lucene.document.StoredField;
-import org.apache.lucene.document.TextField;
+import org.apache.lucene.index.DirectoryReader;
+import org.apache.lucene.index.IndexOptions;
 import org.apache.lucene.index.IndexWriter;
 import org.apache.lucene.index.IndexWriterConfig;
+import org.apache.lucene.index.IndexWriterConfig.OpenMode;
+import org.apache.lucene.index.SegmentInfos;
 import org.apache.lucene.index.SerialMergeScheduler;
 import org.apache.lucene.search.similarities.BooleanSimilarity;
 import org.apache.lucene.store.FSDirectory;
 import org.apache.lucene.util.BytesRef;
 import org.openscience.cdk.interfaces.IAtomContainer;
 import cz.iocb.sachem.fingerprint.IOCBFingerprint;
+import cz.iocb.sachem.fingerprint.IntSet;
 import cz.iocb.sachem.molecule.BinaryMolecule;
 import cz.iocb.sachem.molecule.BinaryMoleculeBuilder;
 import cz.iocb.sachem.molecule.InChITools.InChIException;
 import cz.iocb.sachem.molecule.MoleculeCreator;
+import cz.iocb.sachem.molecule.NativeIsomorphism;
 
 
 
@@ -45,6 +50,8 @@ public class Indexer
     private FSDirectory folder;
     private IndexWriter indexer;
     private int segments;
+    private boolean images;
+    private boolean dense;
 
     private Thread[] documentThreads;
     private Thread indexThread;
@@ -55,7 +62,20 @@ public class Indexer
     private Throwable exception;
 
 
-    public void begin(String path, int maxSegments, int bufferedDocs, double bufferSize) throws IOException
+    private static final FieldType fingerprintFieldType = new FieldType();
+
+    static
+    {
+        // the fingerprint terms serve only for the screening, so neither frequencies, positions nor norms are needed
+        fingerprintFieldType.setIndexOptions(IndexOptions.DOCS);
+        fingerprintFieldType.setOmitNorms(true);
+        fingerprintFieldType.setTokenized(true);
+        fingerprintFieldType.freeze();
+    }
+
+
+    public boolean begin(String path, int maxSegments, int bufferedDocs, double bufferSize, boolean matchImages,
+            boolean denseFingerprints) throws IOException
     {
         folder = FSDirectory.open(Paths.get(path));
 
@@ -67,6 +87,10 @@ public class Indexer
 
         try
         {
+            // an index with the legacy fingerprint terms is rebuilt from scratch
+            boolean rebuild = DirectoryReader.indexExists(folder)
+                    && !FingerprintBitMapping.isBinary(SegmentInfos.readLatestCommit(folder).getUserData());
+
             BalancedMergePolicy policy = new BalancedMergePolicy();
 
             IndexWriterConfig config = new IndexWriterConfig(null);
@@ -78,9 +102,16 @@ public class Indexer
             config.setSimilarity(new BooleanSimilarity());
             config.setMergeScheduler(new SerialMergeScheduler());
 
+            if(rebuild)
+                config.setOpenMode(OpenMode.CREATE);
+
             final int cores = Runtime.getRuntime().availableProcessors();
             indexer = new IndexWriter(folder, config);
+            indexer.setLiveCommitData(Map.of(FingerprintBitMapping.formatKey, FingerprintBitMapping.binaryFormat)
+                    .entrySet());
             segments = maxSegments;
+            images = matchImages;
+            dense = denseFingerprints;
 
             moleculeQueue = new ArrayBlockingQueue<IndexItem>(128 * cores);
             documentQueue = new ArrayBlockingQueue<Document>(2 * bufferedDocs);
@@ -106,7 +137,7 @@ public class Indexer
                                 if(exception != null)
                                     continue;
 
-                                Document document = createDocument(item.id, item.molecule);
+                                Document document = createDocument(item.id, item.molecule, images, dense);
                                 documentQueue.put(document);
                             }
                             catch(Throwable e)
@@ -158,6 +189,8 @@ public class Indexer
             thread.start();
 
             indexThread = thread;
+
+            return rebuild;
         }
         catch(Throwable e)
         {
@@ -258,7 +291,7 @@ public class Indexer
     }
 
 
-    private static Document createDocument(int id, byte[] binary)
+    private static Document createDocument(int id, byte[] binary, boolean images, boolean dense)
     {
         Document document = new Document();
         document.add(new IntPoint(Settings.idFieldName, id));
@@ -269,43 +302,63 @@ public class Indexer
 
 
         /* substructure index */
-        Set<Integer> subFp = IOCBFingerprint.getSubstructureFingerprint(molecule);
+        int[] subFp = IOCBFingerprint.getSubstructureFingerprint(molecule);
 
         document.add(new StoredField(Settings.substructureFieldName, binary));
         document.add(new BinaryDocValuesField(Settings.substructureFieldName, new BytesRef(binary)));
-        document.add(new IntPoint(Settings.substructureFieldName, subFp.size()));
-        document.add(new TextField(Settings.substructureFieldName, new FingerprintTokenStream(subFp)));
+        document.add(new IntPoint(Settings.substructureFieldName, subFp.length));
+        document.add(new Field(Settings.substructureFieldName, new FingerprintTokenStream(subFp),
+                fingerprintFieldType));
+
+        if(dense)
+            document.add(new BinaryDocValuesField(Settings.substructureBitsFieldName,
+                    new BytesRef(FoldedFingerprint.asBytes(subFp))));
+
+        if(images)
+        {
+            byte[] image = NativeIsomorphism.image(binary);
+
+            if(image != null)
+                document.add(new BinaryDocValuesField(Settings.substructureImageFieldName, new BytesRef(image)));
+        }
 
 
         /* similarity index */
-        List<List<Integer>> simFp = IOCBFingerprint.getSimilarityFingerprint(molecule, Settings.maximumSimilarityDepth);
+        int[][] simFp = IOCBFingerprint.getSimilarityFingerprint(molecule, Settings.maximumSimilarityDepth);
+
+        int length = 0;
+
+        for(int[] seg : simFp)
+            length += seg.length + 1;
 
-        byte[] array = new byte[simFp.stream().map(i -> i.size() + 1).reduce(0, Integer::sum) * Integer.BYTES];
+        byte[] array = new byte[length * Integer.BYTES];
 
-        for(int pos = 0, i = 0; i < simFp.size(); i++)
+        for(int pos = 0, i = 0; i < simFp.length; i++)
         {
             for(int b = 0; b < Integer.BYTES; b++)
-                array[pos++] = (byte) (simFp.get(i).size() >> (8 * b));
+                array[pos++] = (byte) (simFp[i].length >> (8 * b));
 
-            for(int bit : simFp.get(i))
+            for(int bit : simFp[i])
                 for(int b = 0; b < Integer.BYTES; b++)
                     array[pos++] = (byte) (bit >> (8 * b));
         }
 
 
-        Set<Integer> bits = new HashSet<Integer>();
+        IntSet bits = new IntSet(length);
 
-        for(List<Integer> seg : simFp)
-            bits.addAll(seg);
+        for(int[] seg : simFp)
+            for(int bit : seg)
+                bits.add(bit);
 
 
-        document.add(new TextField(Settings.similarityFieldName, new FingerprintTokenStream(bits)));
+        document.add(new Field(Settings.similarityFieldName, new FingerprintTokenStream(bits.toArray()),
+                fingerprintFieldType));
         document.add(new StoredField(Settings.similarityFieldName, array));
         document.add(new BinaryDocValuesField(Settings.similarityFieldName, new BytesRef(array)));
 
-        for(int size = 0, i = 0; i < simFp.size(); i++)
+        for(int size = 0, i = 0; i < simFp.length; i++)
         {
-            size += simFp.get(i).size();
+            size += simFp[i].length;
             document.add(new IntPoint(Settings.similarityFieldName, size));
             size += SimilarStructureQuery.iterationSizeOffset;
         }
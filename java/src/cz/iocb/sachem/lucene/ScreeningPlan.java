@@ -0,0 +1,234 @@
+package cz.iocb.sachem.lucene;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import org.apache.lucene.search.Explanation;
+
+
+
+final class ScreeningPlan
+{
+    // relative costs of advancing a posting list to a candidate and of verifying a candidate by the isomorphism
+    // or, for elementary queries, by a scan of the stored record
+    static final double advanceCost = 1;
+    static final double isomorphismCost = 200;
+    static final double scanCost = 4;
+
+    // relative cost of testing the folded fingerprint of a document when all documents are scanned instead
+    static final double bitsetTestCost = 0.5;
+
+    static final int maxSize = 64;
+
+    // minimal number of sampled documents to estimate a conditional bit frequency from
+    static final int minSupport = 8;
+
+    private final int docCount;
+    private final int candidateCount;
+    private final double verificationCost;
+    private final double postingsCost;
+    private final int[] bits;
+    private final int[] docFreqs;
+    private final double[] estimates;
+    private final String[] sources;
+    private final int size;
+
+
+    ScreeningPlan(int[] fp, FingerprintStatistics statistics, double verificationCost)
+    {
+        int length = fp.length;
+        int sampleSize = statistics.sampleSize();
+        long[][] samples = new long[length][];
+        int[] sampleFreqs = new int[length];
+
+        for(int i = 0; i < length; i++)
+        {
+            samples[i] = statistics.samples(fp[i]);
+            sampleFreqs[i] = cardinality(samples[i]);
+        }
+
+        // the sampled documents containing all the selected bits
+        long[] support = new long[(sampleSize + 63) / 64];
+        int supportCount = sampleSize;
+
+        for(int i = 0; i < sampleSize; i++)
+            support[i >> 6] |= 1L << i;
+
+        // the highest frequency of a bit among the documents containing any single selected bit
+        double[] pairwise = new double[length];
+        Arrays.fill(pairwise, -1);
+
+        boolean[] used = new boolean[length];
+
+        docCount = statistics.docCount();
+        candidateCount = length;
+        this.verificationCost = verificationCost;
+        bits = new int[Math.min(length, maxSize)];
+        docFreqs = new int[bits.length];
+        estimates = new double[bits.length];
+        sources = new String[bits.length];
+
+        double estimate = docCount;
+        double postingsCost = 0;
+        int size = 0;
+
+        while(size < bits.length)
+        {
+            int best = -1;
+            double bestGain = 0;
+            double bestEstimate = 0;
+            double bestCost = 0;
+            String bestSource = null;
+
+            for(int i = 0; i < length; i++)
+            {
+                if(used[i])
+                    continue;
+
+                int docFreq = statistics.docFreq(fp[i]);
+                double newEstimate;
+                double cost;
+                String source;
+
+                if(size == 0)
+                {
+                    // the first bit leads the conjunction, so all its postings are visited
+                    newEstimate = docFreq;
+                    cost = docFreq * advanceCost;
+                    source = "exact";
+                }
+                else
+                {
+                    double frequency;
+
+                    if(supportCount >= minSupport)
+                    {
+                        int hits = intersection(support, samples[i]);
+
+                        // a bit missing in all the supporting samples is still expected to be somewhat rare
+                        frequency = hits > 0 ? hits / (double) supportCount
+                                : Math.min(docFreq / (double) docCount, 0.5 / supportCount);
+                        source = "sampled";
+                    }
+                    else if(pairwise[i] >= 0)
+                    {
+                        frequency = pairwise[i];
+                        source = "pairwise";
+                    }
+                    else
+                    {
+                        frequency = docFreq / (double) docCount;
+                        source = "independent";
+                    }
+
+                    // each remaining candidate is checked against the postings of the added bit
+                    newEstimate = Math.min(estimate * frequency, docFreq);
+                    cost = Math.min(docFreq, estimate) * advanceCost;
+                }
+
+                double gain = (estimate - newEstimate) * verificationCost - cost;
+
+                if(gain > bestGain)
+                {
+                    best = i;
+                    bestGain = gain;
+                    bestEstimate = newEstimate;
+                    bestCost = cost;
+                    bestSource = source;
+                }
+            }
+
+            if(best < 0)
+                break;
+
+            used[best] = true;
+            estimate = bestEstimate;
+            postingsCost += bestCost;
+
+            bits[size] = fp[best];
+            docFreqs[size] = statistics.docFreq(fp[best]);
+            estimates[size] = bestEstimate;
+            sources[size] = bestSource;
+            size++;
+
+            supportCount = 0;
+
+            for(int w = 0; w < support.length; w++)
+            {
+                support[w] &= samples[best] != null ? samples[best][w] : 0;
+                supportCount += Long.bitCount(support[w]);
+            }
+
+            if(sampleFreqs[best] >= minSupport)
+            {
+                for(int i = 0; i < length; i++)
+                    if(!used[i])
+                        pairwise[i] = Math.max(pairwise[i],
+                                intersection(samples[best], samples[i]) / (double) sampleFreqs[best]);
+            }
+        }
+
+        this.size = size;
+
+        // without any bit, the screening iterates over all documents having the field
+        this.postingsCost = size > 0 ? postingsCost : docCount * advanceCost;
+    }
+
+
+    private static int cardinality(long[] set)
+    {
+        int count = 0;
+
+        if(set != null)
+            for(long word : set)
+                count += Long.bitCount(word);
+
+        return count;
+    }
+
+
+    private static int intersection(long[] set1, long[] set2)
+    {
+        int count = 0;
+
+        if(set1 != null && set2 != null)
+            for(int w = 0; w < set1.length; w++)
+                count += Long.bitCount(set1[w] & set2[w]);
+
+        return count;
+    }
+
+
+    int[] bits()
+    {
+        return Arrays.copyOf(bits, size);
+    }
+
+
+    boolean prefersBitsetScan()
+    {
+        return docCount * bitsetTestCost < postingsCost;
+    }
+
+
+    double estimate()
+    {
+        return size > 0 ? estimates[size - 1] : docCount;
+    }
+
+
+    Explanation explain()
+    {
+        List<Explanation> details = new ArrayList<Explanation>(size);
+
+        for(int i = 0; i < size; i++)
+            details.add(Explanation.match((float) estimates[i], String.format("bit %08x, docFreq %d, %s estimate",
+                    bits[i], docFreqs[i], sources[i])));
+
+        return Explanation.match((float) estimate(),
+                String.format("screening by %d of %d fingerprint bits in %d documents, verification cost %.0f, "
+                        + "postings cost %.0f, bitset scan cost %.0f", size, candidateCount, docCount, verificationCost,
+                        postingsCost, docCount * bitsetTestCost),
+                details);
+    }
+}
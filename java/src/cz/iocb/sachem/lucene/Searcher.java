@@ -10,7 +10,6 @@ import java.nio.file.WatchEvent;
 import java.nio.file.WatchKey;
 import java.nio.file.WatchService;
 import java.util.HashMap;
-import java.util.List;
 import java.util.concurrent.Executor;
 import java.util.concurrent.Executors;
 import java.util.concurrent.ThreadFactory;
@@ -54,6 +53,8 @@ public class Searcher
     private Path path;
     private Directory folder;
     private IndexSearcher searcher;
+    private FingerprintStatistics substructureStatistics;
+    private FingerprintStatistics similarityStatistics;
     private Thread watcher;
     private int threadCount;
 
@@ -95,6 +96,11 @@ public class Searcher
         searcher = new IndexSearcher(DirectoryReader.open(folder), executor);
         searcher.setSimilarity(new BooleanSimilarity());
 
+        // the bit statistics are shared by all queries until the reader is reopened
+        substructureStatistics = new FingerprintStatistics(searcher.getIndexReader(), Settings.substructureFieldName,
+                FingerprintStatistics.defaultSampleSize);
+        similarityStatistics = new FingerprintStatistics(searcher.getIndexReader(), Settings.similarityFieldName, 0);
+
 
         watcher = new Thread()
         {
@@ -155,9 +161,9 @@ public class Searcher
             IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode, AromaticityMode aromaticityMode,
             TautomerMode tautomerMode, long matchingLimit) throws IOException, CDKException, TimeoutException
     {
-        SubstructureQuery query = new SubstructureQuery(Settings.substructureFieldName, new String(molecule),
-                searchMode, chargeMode, isotopeMode, radicalMode, stereoMode, aromaticityMode, tautomerMode,
-                matchingLimit);
+        SubstructureQuery query = new SubstructureQuery(Settings.substructureFieldName, substructureStatistics,
+                new String(molecule), searchMode, chargeMode, isotopeMode, radicalMode, stereoMode, aromaticityMode,
+                tautomerMode, matchingLimit);
 
         if(n == 0)
             return new SearchResult(query.name);
@@ -170,12 +176,24 @@ public class Searcher
     }
 
 
+    public String subexplain(byte[] molecule, SearchMode searchMode, ChargeMode chargeMode, IsotopeMode isotopeMode,
+            RadicalMode radicalMode, StereoMode stereoMode, AromaticityMode aromaticityMode, TautomerMode tautomerMode)
+            throws IOException, CDKException, TimeoutException
+    {
+        SubstructureQuery query = new SubstructureQuery(Settings.substructureFieldName, substructureStatistics,
+                new String(molecule), searchMode, chargeMode, isotopeMode, radicalMode, stereoMode, aromaticityMode,
+                tautomerMode, 0);
+
+        return query.explainPlan();
+    }
+
+
     public SearchResult simsearch(byte[] molecule, int n, boolean sort, float threshold, int depth,
             AromaticityMode aromaticityMode, TautomerMode tautomerMode)
             throws IOException, CDKException, TimeoutException
     {
-        SimilarStructureQuery query = new SimilarStructureQuery(Settings.similarityFieldName, new String(molecule),
-                threshold, depth, aromaticityMode, tautomerMode);
+        SimilarStructureQuery query = new SimilarStructureQuery(Settings.similarityFieldName, similarityStatistics,
+                new String(molecule), threshold, depth, aromaticityMode, tautomerMode);
 
 
         if(n == 0)
@@ -198,25 +216,37 @@ public class Searcher
         BinaryMolecule bin1 = new BinaryMolecule(BinaryMoleculeBuilder.asBytes(molecule1, false));
         BinaryMolecule bin2 = new BinaryMolecule(BinaryMoleculeBuilder.asBytes(molecule2, false));
 
-        List<List<Integer>> fp1 = IOCBFingerprint.getSimilarityFingerprint(bin1, depth);
-        List<List<Integer>> fp2 = IOCBFingerprint.getSimilarityFingerprint(bin2, depth);
+        int[][] fp1 = IOCBFingerprint.getSimilarityFingerprint(bin1, depth);
+        int[][] fp2 = IOCBFingerprint.getSimilarityFingerprint(bin2, depth);
 
         int shared = 0;
         int size = 0;
 
         for(int d = 0; d < depth; d++)
         {
-            List<Integer> it1 = fp1.get(d);
-            List<Integer> it2 = fp2.get(d);
-
-            int size1 = it1.size();
-            int size2 = it2.size();
+            int[] it1 = fp1[d];
+            int[] it2 = fp2[d];
 
-            for(Integer i : it2)
-                it1.remove(i);
+            // both iterations are sorted, so the shared values are counted by merging them
+            for(int i1 = 0, i2 = 0; i1 < it1.length && i2 < it2.length;)
+            {
+                if(it1[i1] < it2[i2])
+                {
+                    i1++;
+                }
+                else if(it1[i1] > it2[i2])
+                {
+                    i2++;
+                }
+                else
+                {
+                    shared++;
+                    i1++;
+                    i2++;
+                }
+            }
 
-            size += size1 + size2;
-            shared += size1 - it1.size();
+            size += it1.length + it2.length;
         }
 
         return shared / (float) (size - shared);
@@ -235,6 +265,8 @@ public class Searcher
         finally
         {
             searcher = null;
+            substructureStatistics = null;
+            similarityStatistics = null;
         }
 
 
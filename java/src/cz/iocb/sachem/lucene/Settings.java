@@ -6,6 +6,8 @@ class Settings
 {
     static final String idFieldName = "id";
     static final String substructureFieldName = "mol_sub";
+    static final String substructureImageFieldName = "mol_img";
+    static final String substructureBitsFieldName = "mol_bits";
     static final String similarityFieldName = "mol_sim";
     static final int maximumSimilarityDepth = 3;
 }
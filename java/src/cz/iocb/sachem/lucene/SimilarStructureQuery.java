@@ -2,18 +2,14 @@ package cz.iocb.sachem.lucene;
 
 import java.io.IOException;
 import java.util.ArrayList;
-import java.util.HashMap;
-import java.util.HashSet;
-import java.util.List;
+import java.util.Arrays;
 import java.util.Map;
-import java.util.Set;
 import java.util.TreeMap;
 import java.util.concurrent.TimeoutException;
 import org.apache.lucene.document.IntPoint;
 import org.apache.lucene.index.BinaryDocValues;
 import org.apache.lucene.index.DocValues;
 import org.apache.lucene.index.LeafReaderContext;
-import org.apache.lucene.index.Term;
 import org.apache.lucene.search.BooleanClause;
 import org.apache.lucene.search.BooleanQuery;
 import org.apache.lucene.search.BooleanQuery.Builder;
@@ -32,6 +28,7 @@ import org.apache.lucene.util.BytesRef;
 import org.openscience.cdk.exception.CDKException;
 import org.openscience.cdk.interfaces.IAtomContainer;
 import cz.iocb.sachem.fingerprint.IOCBFingerprint;
+import cz.iocb.sachem.fingerprint.IntIntMap;
 import cz.iocb.sachem.molecule.AromaticityMode;
 import cz.iocb.sachem.molecule.BinaryMolecule;
 import cz.iocb.sachem.molecule.BinaryMoleculeBuilder;
@@ -50,6 +47,7 @@ public class SimilarStructureQuery extends Query
     public final static int iterationSizeOffset = 1 << 28;
 
     private final String field;
+    private final FingerprintStatistics statistics;
     private final String query;
     private final AromaticityMode aromaticityMode;
     private final TautomerMode tautomerMode;
@@ -59,11 +57,12 @@ public class SimilarStructureQuery extends Query
     final String name;
 
 
-    public SimilarStructureQuery(String field, String query, float threshold, int similarityRadius,
-            AromaticityMode aromaticityMode, TautomerMode tautomerMode)
+    SimilarStructureQuery(String field, FingerprintStatistics statistics, String query, float threshold,
+            int similarityRadius, AromaticityMode aromaticityMode, TautomerMode tautomerMode)
             throws CDKException, IOException, TimeoutException
     {
         this.field = field;
+        this.statistics = statistics;
         this.query = query;
         this.threshold = threshold;
         this.similarityRadius = similarityRadius;
@@ -132,7 +131,7 @@ public class SimilarStructureQuery extends Query
         private final Query parentQuery;
         private final IAtomContainer tautomer;
 
-        private final List<List<Integer>> fp;
+        private final int[][] fp;
         private final int fpSize;
 
 
@@ -144,7 +143,7 @@ public class SimilarStructureQuery extends Query
             BinaryMolecule molecule = new BinaryMolecule(BinaryMoleculeBuilder.asBytes(tautomer, false));
 
             this.fp = IOCBFingerprint.getSimilarityFingerprint(molecule, similarityRadius);
-            this.fpSize = fp.stream().map(i -> i.size()).reduce(0, Integer::sum);
+            this.fpSize = Arrays.stream(fp).mapToInt(i -> i.length).sum();
         }
 
 
@@ -196,7 +195,7 @@ public class SimilarStructureQuery extends Query
                 super(SimilarStructureQuery.this);
 
                 Builder builder = new BooleanQuery.Builder();
-                FingerprintBitMapping mapping = new FingerprintBitMapping();
+                FingerprintBitMapping mapping = new FingerprintBitMapping(searcher.getIndexReader());
 
                 int min = similarityRadius * iterationSizeOffset + (int) Math.floor(fpSize * threshold);
                 int max = similarityRadius * iterationSizeOffset + (int) Math.ceil(fpSize / threshold);
@@ -204,7 +203,7 @@ public class SimilarStructureQuery extends Query
                 builder.add(IntPoint.newRangeQuery(field, min, max), BooleanClause.Occur.MUST);
 
                 for(int bit : selectFingerprintBits(searcher))
-                    builder.add(new TermQuery(new Term(field, mapping.bitAsString(bit))), BooleanClause.Occur.SHOULD);
+                    builder.add(new TermQuery(mapping.bitAsTerm(field, bit)), BooleanClause.Occur.SHOULD);
 
                 builder.setMinimumNumberShouldMatch(1);
 
@@ -236,54 +235,47 @@ public class SimilarStructureQuery extends Query
             {
                 Scorer scorer = scorer(context);
 
-                if(scorer != null && doc != scorer.iterator().advance(doc))
+                if(scorer != null && scorer.iterator().advance(doc) == doc)
                     return Explanation.match(scorer.score(), "match");
 
                 return Explanation.noMatch("no match");
             }
 
 
-            private Set<Integer> selectFingerprintBits(IndexSearcher searcher) throws IOException
+            private int[] selectFingerprintBits(IndexSearcher searcher) throws IOException
             {
                 int limit = (int) Math.ceil(fpSize * (1 - threshold));
 
-                FingerprintBitMapping mapping = new FingerprintBitMapping();
-                Map<Integer, Integer> bits = new HashMap<Integer, Integer>();
+                IntIntMap bits = new IntIntMap(fpSize);
                 Map<Integer, Integer> ordered = new TreeMap<Integer, Integer>();
 
-                for(List<Integer> segment : fp)
+                for(int[] segment : fp)
                 {
-                    for(Integer i : segment)
+                    for(int i : segment)
                     {
-                        Integer count = bits.get(i);
+                        if(bits.get(i) == 0)
+                            ordered.put(statistics.docFreq(i), i);
 
-                        if(count == null)
-                        {
-                            bits.put(i, 1);
-                            ordered.put(searcher.getIndexReader().docFreq(new Term(field, mapping.bitAsString(i))), i);
-                        }
-                        else
-                        {
-                            bits.put(i, count + 1);
-                        }
+                        bits.add(i, 1);
                     }
                 }
 
 
-                Set<Integer> selected = new HashSet<Integer>();
+                int[] selected = new int[ordered.size()];
 
+                int size = 0;
                 int count = 0;
 
-                for(Integer bit : ordered.values())
+                for(int bit : ordered.values())
                 {
-                    selected.add(bit);
+                    selected[size++] = bit;
                     count += bits.get(bit);
 
                     if(count > limit)
                         break;
                 }
 
-                return selected;
+                return Arrays.copyOf(selected, size);
             }
 
 
@@ -333,7 +325,7 @@ public class SimilarStructureQuery extends Query
                     int dbSize = 0;
                     int shared = 0;
 
-                    for(List<Integer> iteration : fp)
+                    for(int[] iteration : fp)
                     {
                         int size = 0;
 
@@ -347,13 +339,13 @@ public class SimilarStructureQuery extends Query
                             for(int b = 0; b < 4; b++)
                                 value |= Byte.toUnsignedInt(data.bytes[offset + i * Integer.BYTES + b]) << (b * 8);
 
-                            while(idx < iteration.size() && iteration.get(idx) < value)
+                            while(idx < iteration.length && iteration[idx] < value)
                                 idx++;
 
-                            if(idx == iteration.size())
+                            if(idx == iteration.length)
                                 break;
 
-                            if(iteration.get(idx) == value)
+                            if(iteration[idx] == value)
                             {
                                 shared++;
                                 idx++;
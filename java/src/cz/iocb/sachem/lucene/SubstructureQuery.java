@@ -1,23 +1,23 @@
 package cz.iocb.sachem.lucene;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
-import java.util.TreeMap;
 import java.util.concurrent.TimeoutException;
 import org.apache.lucene.index.BinaryDocValues;
 import org.apache.lucene.index.DocValues;
 import org.apache.lucene.index.IndexReader;
 import org.apache.lucene.index.LeafReaderContext;
-import org.apache.lucene.index.Term;
 import org.apache.lucene.search.BooleanClause;
 import org.apache.lucene.search.BooleanQuery;
 import org.apache.lucene.search.BooleanQuery.Builder;
 import org.apache.lucene.search.ConstantScoreQuery;
+import org.apache.lucene.search.ConstantScoreScorer;
 import org.apache.lucene.search.DisjunctionMaxQuery;
 import org.apache.lucene.search.DocIdSetIterator;
 import org.apache.lucene.search.Explanation;
@@ -28,6 +28,7 @@ import org.apache.lucene.search.QueryVisitor;
 import org.apache.lucene.search.ScoreMode;
 import org.apache.lucene.search.Scorer;
 import org.apache.lucene.search.TermQuery;
+import org.apache.lucene.search.TwoPhaseIterator;
 import org.apache.lucene.search.Weight;
 import org.apache.lucene.util.BytesRef;
 import org.openscience.cdk.CDKConstants;
@@ -44,6 +45,7 @@ import cz.iocb.sachem.molecule.MoleculeCreator;
 import cz.iocb.sachem.molecule.MoleculeCreator.QueryMolecule;
 import cz.iocb.sachem.molecule.NativeIsomorphism;
 import cz.iocb.sachem.molecule.NativeIsomorphism.IterationLimitExceededException;
+import cz.iocb.sachem.molecule.NativeIsomorphismSet;
 import cz.iocb.sachem.molecule.RadicalMode;
 import cz.iocb.sachem.molecule.SearchMode;
 import cz.iocb.sachem.molecule.StereoMode;
@@ -54,6 +56,7 @@ import cz.iocb.sachem.molecule.TautomerMode;
 public class SubstructureQuery extends Query
 {
     private final String field;
+    private final FingerprintStatistics statistics;
     private final String query;
     private final SearchMode searchMode;
     private final ChargeMode chargeMode;
@@ -63,15 +66,18 @@ public class SubstructureQuery extends Query
     private final AromaticityMode aromaticityMode;
     private final TautomerMode tautomerMode;
     private final long iterationLimit;
+    private final List<SingleSubstructureQuery> subqueries;
     private final Query subquery;
     final String name;
 
 
-    public SubstructureQuery(String field, String query, SearchMode searchMode, ChargeMode chargeMode,
-            IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode, AromaticityMode aromaticityMode,
-            TautomerMode tautomerMode, long iterationLimit) throws CDKException, IOException, TimeoutException
+    SubstructureQuery(String field, FingerprintStatistics statistics, String query, SearchMode searchMode,
+            ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode,
+            AromaticityMode aromaticityMode, TautomerMode tautomerMode, long iterationLimit)
+            throws CDKException, IOException, TimeoutException
     {
         this.field = field;
+        this.statistics = statistics;
         this.query = query;
         this.searchMode = searchMode;
         this.chargeMode = chargeMode;
@@ -87,12 +93,26 @@ public class SubstructureQuery extends Query
 
         this.name = queryMolecules.name;
 
-        ArrayList<Query> subqueries = new ArrayList<Query>(queryMolecules.tautomers.size());
+        this.subqueries = new ArrayList<SingleSubstructureQuery>(queryMolecules.tautomers.size());
 
         for(IAtomContainer molecule : queryMolecules.tautomers)
             subqueries.add(new SingleSubstructureQuery(molecule));
 
-        this.subquery = new DisjunctionMaxQuery(subqueries, 0);
+        if(subqueries.size() > 1)
+            this.subquery = new TautomerSubstructureQuery(subqueries);
+        else
+            this.subquery = new DisjunctionMaxQuery(subqueries, 0);
+    }
+
+
+    String explainPlan()
+    {
+        StringBuilder builder = new StringBuilder();
+
+        for(SingleSubstructureQuery subquery : subqueries)
+            builder.append(subquery.plan.explain());
+
+        return builder.toString();
     }
 
 
@@ -157,11 +177,13 @@ public class SubstructureQuery extends Query
         private final Query parentQuery;
         private final IAtomContainer tautomer;
 
-        private final Set<Integer> fp;
+        private final int[] fp;
         private final Map<Integer, Set<Integer>> info;
         private final BinaryMolecule molecule;
         private final byte[] moleculeData;
         private final boolean[] restH;
+        private final boolean elementary;
+        private final ScreeningPlan plan;
 
 
         SingleSubstructureQuery(IAtomContainer tautomer) throws CDKException, IOException
@@ -199,6 +221,18 @@ public class SubstructureQuery extends Query
             this.molecule = new BinaryMolecule(moleculeData);
             this.info = new HashMap<Integer, Set<Integer>>();
             this.fp = IOCBFingerprint.getSubstructureFingerprint(molecule, info);
+
+            // with these modes, a target matches an elementary query whenever it contains its atom or bond, so the
+            // isomorphism can be replaced by a scan of the stored record, which also rules out fingerprint collisions;
+            // implicit hydrogens are not written into the query record, so queries like "Br" or "O" qualify, but the
+            // scan does not check hydrogens, so any query with explicit hydrogen atoms (e.g. "[H]Br", or a molfile
+            // with H atoms) is left to the isomorphism
+            this.elementary = searchMode == SearchMode.SUBSTRUCTURE && restH == null
+                    && chargeMode != ChargeMode.DEFAULT_AS_UNCHARGED && isotopeMode != IsotopeMode.DEFAULT_AS_STANDARD
+                    && radicalMode != RadicalMode.DEFAULT_AS_STANDARD && BinaryMolecule.isElementary(moleculeData);
+
+            this.plan = new ScreeningPlan(fp, statistics,
+                    elementary ? ScreeningPlan.scanCost : ScreeningPlan.isomorphismCost);
         }
 
 
@@ -243,19 +277,42 @@ public class SubstructureQuery extends Query
         class SingleSubstructureWeight extends Weight
         {
             private final Weight innerWeight;
+            private final FoldedFingerprint folded;
+            private final int[] atomWeights;
+            private final NativeIsomorphism isomorphism;
 
 
             public SingleSubstructureWeight(IndexSearcher searcher, ScoreMode scoreMode, float boost) throws IOException
             {
                 super(SubstructureQuery.this);
 
-                if(!fp.isEmpty())
+                if(fp.length != 0)
+                {
+                    this.atomWeights = new int[molecule.getAtomCount()];
+                    Arrays.fill(atomWeights, Integer.MAX_VALUE);
+
+                    // an atom is as selective as the rarest fragment it belongs to
+                    for(int i : fp)
+                        for(int a : info.get(i))
+                            atomWeights[a] = Math.min(atomWeights[a], statistics.docFreq(i));
+                }
+                else
+                {
+                    this.atomWeights = null;
+                }
+
+                // the folded fingerprints are scanned only if the planned postings are expected to be more expensive
+                this.folded = fp.length != 0 && plan.prefersBitsetScan() ? new FoldedFingerprint(fp) : null;
+
+                int[] bits = plan.bits();
+
+                if(bits.length != 0)
                 {
                     Builder builder = new BooleanQuery.Builder();
-                    FingerprintBitMapping mapping = new FingerprintBitMapping();
+                    FingerprintBitMapping mapping = new FingerprintBitMapping(searcher.getIndexReader());
 
-                    for(int bit : selectFingerprintBits(searcher))
-                        builder.add(new TermQuery(new Term(field, mapping.bitAsString(bit))), BooleanClause.Occur.MUST);
+                    for(int bit : bits)
+                        builder.add(new TermQuery(mapping.bitAsTerm(field, bit)), BooleanClause.Occur.MUST);
 
                     this.innerWeight = new ConstantScoreQuery(builder.build()).createWeight(searcher,
                             ScoreMode.COMPLETE_NO_SCORES, boost);
@@ -265,21 +322,63 @@ public class SubstructureQuery extends Query
                     this.innerWeight = new FieldExistsQuery(field).createWeight(searcher, ScoreMode.COMPLETE_NO_SCORES,
                             boost);
                 }
+
+                this.isomorphism = new NativeIsomorphism(moleculeData, restH, atomWeights, searchMode, chargeMode,
+                        isotopeMode, radicalMode, stereoMode);
             }
 
 
             @Override
             public Scorer scorer(LeafReaderContext context) throws IOException
             {
-                Scorer scorer = innerWeight.scorer(context);
+                Scorer scorer = screeningScorer(context);
 
                 if(scorer == null)
                     return null;
 
+                if(elementary)
+                    return new ElementarySubstructureScorer(context, scorer);
+
                 return new SingleSubstructureScorer(context, scorer);
             }
 
 
+            Scorer screeningScorer(LeafReaderContext context) throws IOException
+            {
+                if(folded == null)
+                    return innerWeight.scorer(context);
+
+                BinaryDocValues bits = context.reader().getBinaryDocValues(Settings.substructureBitsFieldName);
+
+                // segments indexed without the folded fingerprints are screened by the postings
+                if(bits == null)
+                    return innerWeight.scorer(context);
+
+                TwoPhaseIterator iterator = new TwoPhaseIterator(DocIdSetIterator.all(context.reader().maxDoc()))
+                {
+                    @Override
+                    public boolean matches() throws IOException
+                    {
+                        if(!bits.advanceExact(approximation.docID()))
+                            return true;
+
+                        BytesRef ref = bits.binaryValue();
+
+                        return ref.length != FoldedFingerprint.length || folded.isSubsetOf(ref.bytes, ref.offset);
+                    }
+
+
+                    @Override
+                    public float matchCost()
+                    {
+                        return FoldedFingerprint.length / Long.BYTES;
+                    }
+                };
+
+                return new ConstantScoreScorer(this, 0, ScoreMode.COMPLETE_NO_SCORES, iterator);
+            }
+
+
             @Override
             public boolean isCacheable(LeafReaderContext context)
             {
@@ -292,72 +391,246 @@ public class SubstructureQuery extends Query
             {
                 Scorer scorer = scorer(context);
 
-                if(scorer != null && doc != scorer.iterator().advance(doc))
-                    return Explanation.match(scorer.score(), "match");
+                if(scorer != null && scorer.iterator().advance(doc) == doc)
+                    return Explanation.match(scorer.score(), "match", plan.explain());
 
-                return Explanation.noMatch("no match");
+                return Explanation.noMatch("no match", plan.explain());
             }
 
 
-            private List<Integer> selectFingerprintBits(IndexSearcher searcher) throws IOException
+            class SingleSubstructureScorer extends Scorer
             {
-                final int maxSize = 32;
-                final int atomCoverage = 2;
+                private static final int batchSize = 128;
 
-                Map<Integer, Integer> ordered = new TreeMap<Integer, Integer>();
-                FingerprintBitMapping mapping = new FingerprintBitMapping();
+                private int docID = -1;
+                private float score = 0;
+                private final Scorer innerScorer;
+                private final BinaryDocValues molDocValue;
+                private final BinaryDocValues imageDocValue;
+                private final NativeIsomorphism isomorphism;
 
-                for(int i : fp)
-                    ordered.put(searcher.getIndexReader().docFreq(new Term(field, mapping.bitAsString(i))), i);
+                private final int[] batchDocIDs = new int[batchSize];
+                private final int[] batchOffsets = new int[batchSize];
+                private final float[] batchScores = new float[batchSize];
+                private ByteBuffer batchData = ByteBuffer.allocateDirect(64 * batchSize);
+                private int batchLength = 0;
+                private int batchPosition = 0;
+                private boolean exhausted = false;
 
-                List<Integer> selected = new ArrayList<Integer>(maxSize);
-                int[] coverage = new int[molecule.getAtomCount()];
-                int uncovered = molecule.getAtomCount();
 
-                for(Integer i : ordered.values())
+                protected SingleSubstructureScorer(LeafReaderContext context, Scorer scorer) throws IOException
                 {
-                    if(uncovered <= 0 || selected.size() >= maxSize)
-                        break;
+                    super(SingleSubstructureWeight.this);
+                    this.innerScorer = scorer;
+                    this.molDocValue = DocValues.getBinary(context.reader(), field);
+                    this.imageDocValue = context.reader().getBinaryDocValues(Settings.substructureImageFieldName);
 
-                    boolean found = false;
+                    // the fork owns the workspace, which is released together with the scorer
+                    this.isomorphism = SingleSubstructureWeight.this.isomorphism.fork();
+                }
 
-                    for(int a : info.get(i))
+
+                @Override
+                public int docID()
+                {
+                    return docID;
+                }
+
+
+                @Override
+                public float getMaxScore(int upTo) throws IOException
+                {
+                    return 1.0f;
+                }
+
+
+                @Override
+                public float score() throws IOException
+                {
+                    return score;
+                }
+
+
+                private BytesRef moleculeValue(int doc) throws IOException
+                {
+                    if(imageDocValue != null && imageDocValue.advanceExact(doc))
+                        return imageDocValue.binaryValue();
+
+                    molDocValue.advanceExact(doc);
+                    return molDocValue.binaryValue();
+                }
+
+
+                private boolean isValid() throws IOException
+                {
+                    BytesRef ref = moleculeValue(docID);
+
+                    try
                     {
-                        if(coverage[a] < atomCoverage)
+                        score = isomorphism.match(ref.bytes, ref.offset, ref.length, iterationLimit);
+
+                        if(score == Float.NEGATIVE_INFINITY)
+                            throw new RuntimeException();
+
+                        if(score == 0)
+                            score = Float.MIN_VALUE;
+                    }
+                    catch(IterationLimitExceededException e)
+                    {
+                        score = 0.0f;
+                    }
+
+                    return !Float.isNaN(score);
+                }
+
+
+                private void fillBatch(DocIdSetIterator iterator, int doc) throws IOException
+                {
+                    batchData.clear();
+                    batchLength = 0;
+                    batchPosition = 0;
+
+                    while(true)
+                    {
+                        if(doc == DocIdSetIterator.NO_MORE_DOCS)
                         {
-                            found = true;
-                            coverage[a]++;
+                            exhausted = true;
+                            break;
+                        }
 
-                            if(coverage[a] == atomCoverage)
-                                uncovered--;
+                        BytesRef ref = moleculeValue(doc);
+                        int position = (batchData.position() + 3) & ~3;
+
+                        if(batchData.capacity() - position < ref.length)
+                        {
+                            ByteBuffer data = ByteBuffer.allocateDirect(2 * (position + ref.length));
+                            batchData.flip();
+                            data.put(batchData);
+                            batchData = data;
                         }
+
+                        batchData.position(position);
+
+                        batchDocIDs[batchLength] = doc;
+                        batchOffsets[batchLength] = batchData.position();
+                        batchData.put(ref.bytes, ref.offset, ref.length);
+
+                        if(++batchLength == batchSize)
+                            break;
+
+                        doc = iterator.nextDoc();
                     }
 
-                    if(found)
-                        selected.add(i);
+                    if(batchLength > 0)
+                        isomorphism.match(batchData, batchOffsets, batchLength, iterationLimit, batchScores);
                 }
 
-                return selected;
+
+                private int nextValidDoc(DocIdSetIterator iterator) throws IOException
+                {
+                    while(true)
+                    {
+                        while(batchPosition < batchLength)
+                        {
+                            int position = batchPosition++;
+                            float value = batchScores[position];
+
+                            if(Float.isNaN(value))
+                                continue;
+
+                            if(value == NativeIsomorphism.ITERATION_LIMIT_EXCEEDED)
+                                score = 0.0f;
+                            else if(value == 0)
+                                score = Float.MIN_VALUE;
+                            else
+                                score = value;
+
+                            return batchDocIDs[position];
+                        }
+
+                        if(exhausted)
+                            return DocIdSetIterator.NO_MORE_DOCS;
+
+                        fillBatch(iterator, iterator.nextDoc());
+                    }
+                }
+
+
+                @Override
+                public DocIdSetIterator iterator()
+                {
+                    DocIdSetIterator innerDocIdSetIterator = innerScorer.iterator();
+
+                    return new DocIdSetIterator()
+                    {
+                        @Override
+                        public int advance(int target) throws IOException
+                        {
+                            if(batchLength > 0 && target <= batchDocIDs[batchLength - 1])
+                            {
+                                while(batchPosition < batchLength && batchDocIDs[batchPosition] < target)
+                                    batchPosition++;
+
+                                docID = nextValidDoc(innerDocIdSetIterator);
+                                return docID;
+                            }
+
+                            batchLength = 0;
+                            batchPosition = 0;
+
+                            docID = exhausted ? NO_MORE_DOCS : innerDocIdSetIterator.advance(target);
+
+                            if(docID == NO_MORE_DOCS)
+                                exhausted = true;
+                            else if(!isValid())
+                                docID = nextValidDoc(innerDocIdSetIterator);
+
+                            return docID;
+                        }
+
+
+                        @Override
+                        public int nextDoc() throws IOException
+                        {
+                            docID = nextValidDoc(innerDocIdSetIterator);
+                            return docID;
+                        }
+
+
+                        @Override
+                        public int docID()
+                        {
+                            return docID;
+                        }
+
+
+                        @Override
+                        public long cost()
+                        {
+                            return innerDocIdSetIterator.cost();
+                        }
+                    };
+                }
             }
 
 
-            class SingleSubstructureScorer extends Scorer
+            class ElementarySubstructureScorer extends Scorer
             {
                 private int docID = -1;
                 private float score = 0;
                 private final Scorer innerScorer;
                 private final BinaryDocValues molDocValue;
-                private final NativeIsomorphism isomorphism;
+                private final int[] querySizes = new int[4];
+                private final int[] targetSizes = new int[4];
 
 
-                protected SingleSubstructureScorer(LeafReaderContext context, Scorer scorer) throws IOException
+                protected ElementarySubstructureScorer(LeafReaderContext context, Scorer scorer) throws IOException
                 {
                     super(SingleSubstructureWeight.this);
                     this.innerScorer = scorer;
                     this.molDocValue = DocValues.getBinary(context.reader(), field);
 
-                    this.isomorphism = new NativeIsomorphism(moleculeData, restH, searchMode, chargeMode, isotopeMode,
-                            radicalMode, stereoMode);
+                    BinaryMolecule.getSizes(moleculeData, 0, querySizes);
                 }
 
 
@@ -382,15 +655,334 @@ public class SubstructureQuery extends Query
                 }
 
 
-                boolean isValid() throws IOException
+                private boolean isValid() throws IOException
                 {
                     molDocValue.advanceExact(docID);
                     BytesRef ref = molDocValue.binaryValue();
-                    byte[] target = Arrays.copyOfRange(ref.bytes, ref.offset, ref.offset + ref.length);
+
+                    if(!BinaryMolecule.containsElementary(moleculeData, ref.bytes, ref.offset))
+                        return false;
+
+                    BinaryMolecule.getSizes(ref.bytes, ref.offset, targetSizes);
+
+                    // the same weighting of the matched atoms and bonds as the native isomorphism score uses
+                    double heavyAtom = ratio(querySizes[0], targetSizes[0]);
+                    double heavyBond = ratio(querySizes[1], targetSizes[1]);
+                    double hydrogenAtom = ratio(querySizes[2], targetSizes[2]);
+                    double hydrogenBond = ratio(querySizes[3], targetSizes[3]);
+
+                    score = (float) ((8 * heavyAtom + 4 * heavyBond + 2 * hydrogenAtom + 1 * hydrogenBond) / 15);
+
+                    return true;
+                }
+
+
+                private double ratio(int query, int target)
+                {
+                    return target != 0 ? query / (double) target : 1.0;
+                }
+
+
+                @Override
+                public DocIdSetIterator iterator()
+                {
+                    DocIdSetIterator innerDocIdSetIterator = innerScorer.iterator();
+
+                    return new DocIdSetIterator()
+                    {
+                        @Override
+                        public int advance(int target) throws IOException
+                        {
+                            docID = innerDocIdSetIterator.advance(target);
+
+                            while(docID != NO_MORE_DOCS && !isValid())
+                                docID = innerDocIdSetIterator.nextDoc();
+
+                            return docID;
+                        }
+
+
+                        @Override
+                        public int nextDoc() throws IOException
+                        {
+                            docID = innerDocIdSetIterator.nextDoc();
+
+                            while(docID != NO_MORE_DOCS && !isValid())
+                                docID = innerDocIdSetIterator.nextDoc();
+
+                            return docID;
+                        }
+
+
+                        @Override
+                        public int docID()
+                        {
+                            return docID;
+                        }
+
+
+                        @Override
+                        public long cost()
+                        {
+                            return innerDocIdSetIterator.cost();
+                        }
+                    };
+                }
+            }
+        }
+
+
+        @Override
+        public void visit(QueryVisitor visitor)
+        {
+        }
+    }
+
+
+    // matches a target against all tautomers that pass its screening in a single native call, so that the target
+    // is decoded only once; the score is the best tautomer score, as it would be with a DisjunctionMaxQuery
+    class TautomerSubstructureQuery extends Query
+    {
+        private final Query parentQuery;
+        private final List<SingleSubstructureQuery> tautomers;
+
+
+        TautomerSubstructureQuery(List<SingleSubstructureQuery> tautomers)
+        {
+            this.parentQuery = SubstructureQuery.this;
+            this.tautomers = tautomers;
+        }
+
+
+        @Override
+        public Weight createWeight(IndexSearcher searcher, ScoreMode scoreMode, float boost) throws IOException
+        {
+            return new TautomerSubstructureWeight(searcher, scoreMode, boost);
+        }
+
+
+        @Override
+        public boolean equals(Object other)
+        {
+            return sameClassAs(other) && equalsTo(getClass().cast(other));
+        }
+
+
+        private boolean equalsTo(TautomerSubstructureQuery other)
+        {
+            return parentQuery.equals(other.parentQuery);
+        }
+
+
+        @Override
+        public int hashCode()
+        {
+            int result = classHash();
+            result = 31 * result + parentQuery.hashCode();
+            return result;
+        }
+
+
+        @Override
+        public String toString(String field)
+        {
+            //TODO:
+            return "SubstructureSearchQuery.TautomerSubstructureQuery(...)";
+        }
+
+
+        class TautomerSubstructureWeight extends Weight
+        {
+            private final SingleSubstructureQuery.SingleSubstructureWeight[] weights;
+            private final NativeIsomorphismSet isomorphism;
+
+
+            public TautomerSubstructureWeight(IndexSearcher searcher, ScoreMode scoreMode, float boost)
+                    throws IOException
+            {
+                super(SubstructureQuery.this);
+
+                this.weights = new SingleSubstructureQuery.SingleSubstructureWeight[tautomers.size()];
+                NativeIsomorphism[] natives = new NativeIsomorphism[tautomers.size()];
+
+                for(int i = 0; i < weights.length; i++)
+                {
+                    weights[i] = (SingleSubstructureQuery.SingleSubstructureWeight) tautomers.get(i)
+                            .createWeight(searcher, scoreMode, boost);
+                    natives[i] = weights[i].isomorphism;
+                }
+
+                this.isomorphism = new NativeIsomorphismSet(natives);
+            }
+
+
+            @Override
+            public Scorer scorer(LeafReaderContext context) throws IOException
+            {
+                List<Scorer> scorers = new ArrayList<Scorer>(weights.length);
+                int[] indices = new int[weights.length];
+
+                for(int i = 0; i < weights.length; i++)
+                {
+                    Scorer scorer = weights[i].screeningScorer(context);
+
+                    if(scorer != null)
+                    {
+                        indices[scorers.size()] = i;
+                        scorers.add(scorer);
+                    }
+                }
+
+                if(scorers.isEmpty())
+                    return null;
+
+                return new TautomerSubstructureScorer(context, scorers, indices);
+            }
+
+
+            @Override
+            public boolean isCacheable(LeafReaderContext context)
+            {
+                return false;
+            }
+
+
+            @Override
+            public Explanation explain(LeafReaderContext context, int doc) throws IOException
+            {
+                Scorer scorer = scorer(context);
+
+                if(scorer != null && scorer.iterator().advance(doc) == doc)
+                    return Explanation.match(scorer.score(), "match");
+
+                return Explanation.noMatch("no match");
+            }
+
+
+            class TautomerSubstructureScorer extends Scorer
+            {
+                private static final int batchSize = 128;
+
+                private int docID = -1;
+                private float score = 0;
+                private final DocIdSetIterator[] innerIterators;
+                private final int[] innerDocIDs;
+                private final int[] tautomerIndices;
+                private int innerDocID = -1;
+                private final BinaryDocValues molDocValue;
+                private final BinaryDocValues imageDocValue;
+                private final NativeIsomorphismSet isomorphism;
+
+                private final int[] candidates;
+                private final int[] batchDocIDs = new int[batchSize];
+                private final int[] batchOffsets = new int[batchSize];
+                private final int[] batchCandidateOffsets = new int[batchSize + 1];
+                private int[] batchCandidates = new int[4 * batchSize];
+                private final float[] batchScores = new float[batchSize];
+                private ByteBuffer batchData = ByteBuffer.allocateDirect(64 * batchSize);
+                private int batchLength = 0;
+                private int batchPosition = 0;
+                private boolean exhausted = false;
+
+
+                protected TautomerSubstructureScorer(LeafReaderContext context, List<Scorer> scorers, int[] indices)
+                        throws IOException
+                {
+                    super(TautomerSubstructureWeight.this);
+                    this.innerIterators = new DocIdSetIterator[scorers.size()];
+                    this.innerDocIDs = new int[scorers.size()];
+                    this.tautomerIndices = indices;
+                    this.candidates = new int[scorers.size()];
+                    this.molDocValue = DocValues.getBinary(context.reader(), field);
+                    this.imageDocValue = context.reader().getBinaryDocValues(Settings.substructureImageFieldName);
+                    this.isomorphism = TautomerSubstructureWeight.this.isomorphism.fork();
+
+                    for(int i = 0; i < innerIterators.length; i++)
+                    {
+                        innerIterators[i] = scorers.get(i).iterator();
+                        innerDocIDs[i] = -1;
+                    }
+                }
+
+
+                @Override
+                public int docID()
+                {
+                    return docID;
+                }
+
+
+                @Override
+                public float getMaxScore(int upTo) throws IOException
+                {
+                    return 1.0f;
+                }
+
+
+                @Override
+                public float score() throws IOException
+                {
+                    return score;
+                }
+
+
+                private int advanceInner(int target) throws IOException
+                {
+                    if(innerDocID == DocIdSetIterator.NO_MORE_DOCS)
+                        return innerDocID;
+
+                    int doc = DocIdSetIterator.NO_MORE_DOCS;
+
+                    for(int i = 0; i < innerIterators.length; i++)
+                    {
+                        if(innerDocIDs[i] < target)
+                            innerDocIDs[i] = innerIterators[i].advance(target);
+
+                        if(innerDocIDs[i] < doc)
+                            doc = innerDocIDs[i];
+                    }
+
+                    innerDocID = doc;
+                    return doc;
+                }
+
+
+                private int nextInnerDoc() throws IOException
+                {
+                    return advanceInner(innerDocID + 1);
+                }
+
+
+                private int collectCandidates(int[] array, int offset)
+                {
+                    int count = 0;
+
+                    for(int i = 0; i < innerIterators.length; i++)
+                        if(innerDocIDs[i] == innerDocID)
+                            array[offset + count++] = tautomerIndices[i];
+
+                    return count;
+                }
+
+
+                private BytesRef moleculeValue(int doc) throws IOException
+                {
+                    if(imageDocValue != null && imageDocValue.advanceExact(doc))
+                        return imageDocValue.binaryValue();
+
+                    molDocValue.advanceExact(doc);
+                    return molDocValue.binaryValue();
+                }
+
+
+                private boolean isValid() throws IOException
+                {
+                    BytesRef ref = moleculeValue(docID);
+                    int count = collectCandidates(candidates, 0);
 
                     try
                     {
-                        score = isomorphism.match(target, iterationLimit);
+                        score = isomorphism.match(candidates, count, ref.bytes, ref.offset, ref.length, iterationLimit);
 
                         if(score == Float.NEGATIVE_INFINITY)
                             throw new RuntimeException();
@@ -407,20 +999,113 @@ public class SubstructureQuery extends Query
                 }
 
 
+                private void fillBatch(int doc) throws IOException
+                {
+                    batchData.clear();
+                    batchLength = 0;
+                    batchPosition = 0;
+
+                    while(true)
+                    {
+                        if(doc == DocIdSetIterator.NO_MORE_DOCS)
+                        {
+                            exhausted = true;
+                            break;
+                        }
+
+                        BytesRef ref = moleculeValue(doc);
+                        int position = (batchData.position() + 3) & ~3;
+
+                        if(batchData.capacity() - position < ref.length)
+                        {
+                            ByteBuffer data = ByteBuffer.allocateDirect(2 * (position + ref.length));
+                            batchData.flip();
+                            data.put(batchData);
+                            batchData = data;
+                        }
+
+                        batchData.position(position);
+
+                        int candidateOffset = batchCandidateOffsets[batchLength];
+
+                        if(batchCandidates.length - candidateOffset < innerIterators.length)
+                            batchCandidates = Arrays.copyOf(batchCandidates,
+                                    2 * (candidateOffset + innerIterators.length));
+
+                        batchDocIDs[batchLength] = doc;
+                        batchOffsets[batchLength] = batchData.position();
+                        batchCandidateOffsets[batchLength + 1] = candidateOffset
+                                + collectCandidates(batchCandidates, candidateOffset);
+                        batchData.put(ref.bytes, ref.offset, ref.length);
+
+                        if(++batchLength == batchSize)
+                            break;
+
+                        doc = nextInnerDoc();
+                    }
+
+                    if(batchLength > 0)
+                        isomorphism.match(batchData, batchOffsets, batchCandidateOffsets, batchCandidates, batchLength,
+                                iterationLimit, batchScores);
+                }
+
+
+                private int nextValidDoc() throws IOException
+                {
+                    while(true)
+                    {
+                        while(batchPosition < batchLength)
+                        {
+                            int position = batchPosition++;
+                            float value = batchScores[position];
+
+                            if(Float.isNaN(value))
+                                continue;
+
+                            if(value == NativeIsomorphism.ITERATION_LIMIT_EXCEEDED)
+                                score = 0.0f;
+                            else if(value == 0)
+                                score = Float.MIN_VALUE;
+                            else
+                                score = value;
+
+                            return batchDocIDs[position];
+                        }
+
+                        if(exhausted)
+                            return DocIdSetIterator.NO_MORE_DOCS;
+
+                        fillBatch(nextInnerDoc());
+                    }
+                }
+
+
                 @Override
                 public DocIdSetIterator iterator()
                 {
-                    DocIdSetIterator innerDocIdSetIterator = innerScorer.iterator();
-
                     return new DocIdSetIterator()
                     {
                         @Override
                         public int advance(int target) throws IOException
                         {
-                            docID = innerDocIdSetIterator.advance(target);
+                            if(batchLength > 0 && target <= batchDocIDs[batchLength - 1])
+                            {
+                                while(batchPosition < batchLength && batchDocIDs[batchPosition] < target)
+                                    batchPosition++;
+
+                                docID = nextValidDoc();
+                                return docID;
+                            }
+
+                            batchLength = 0;
+                            batchPosition = 0;
 
-                            if(docID != NO_MORE_DOCS && !isValid())
-                                nextDoc();
+                            docID = exhausted ? NO_MORE_DOCS : advanceInner(target);
+
+                            if(docID == NO_MORE_DOCS)
+                                exhausted = true;
+                            else if(!isValid())
+                                docID = nextValidDoc();
 
                             return docID;
                         }
@@ -429,13 +1114,8 @@ public class SubstructureQuery extends Query
                         @Override
                         public int nextDoc() throws IOException
                         {
-                            while(true)
-                            {
-                                docID = innerDocIdSetIterator.nextDoc();
-
-                                if(docID == NO_MORE_DOCS || isValid())
-                                    return docID;
-                            }
+                            docID = nextValidDoc();
+                            return docID;
                         }
 
 
@@ -449,7 +1129,12 @@ public class SubstructureQuery extends Query
                         @Override
                         public long cost()
                         {
-                            return innerDocIdSetIterator.cost();
+                            long cost = 0;
+
+                            for(DocIdSetIterator iterator : innerIterators)
+                                cost += iterator.cost();
+
+                            return cost;
                         }
                     };
                 }
@@ -28,6 +28,7 @@ public final class BinaryMolecule extends Molecule
     private static final int HBOND_BLOCK_SIZE = 2;
     private static final int SPECIAL_BLOCK_SIZE = 3;
 
+    private final byte[] data;
     private final int originalAtomCount;
     private final int originalBondCount;
     private final int atomCount;
@@ -343,6 +344,7 @@ public final class BinaryMolecule extends Molecule
         }
 
 
+        this.data = data;
         this.originalAtomCount = originalAtomCount;
         this.originalBondCount = originalBondCount;
         this.atomCount = atomCount;
@@ -380,6 +382,12 @@ public final class BinaryMolecule extends Molecule
     }
 
 
+    public final byte[] getData()
+    {
+        return data;
+    }
+
+
     @Override
     public final int getOriginalAtomCount()
     {
@@ -645,6 +653,135 @@ public final class BinaryMolecule extends Molecule
     }
 
 
+    // one atom or two atoms joined by one bond, all of specific elements and bond types, with no hydrogens and
+    // no special records (charges, isotopes, radicals, stereo or sgroups)
+    public static boolean isElementary(byte[] data)
+    {
+        int xAtomCount = Byte.toUnsignedInt(data[0]) << 8 | Byte.toUnsignedInt(data[1]);
+        int cAtomCount = Byte.toUnsignedInt(data[2]) << 8 | Byte.toUnsignedInt(data[3]);
+        int hAtomCount = Byte.toUnsignedInt(data[4]) << 8 | Byte.toUnsignedInt(data[5]);
+        int xBondCount = Byte.toUnsignedInt(data[6]) << 8 | Byte.toUnsignedInt(data[7]);
+        int specialCount = Byte.toUnsignedInt(data[8]) << 8 | Byte.toUnsignedInt(data[9]);
+
+        int heavyAtomCount = xAtomCount + cAtomCount;
+
+        if(hAtomCount != 0 || specialCount != 0)
+            return false;
+
+        if(!(heavyAtomCount == 1 && xBondCount == 0 || heavyAtomCount == 2 && xBondCount == 1))
+            return false;
+
+        for(int i = 0; i < xAtomCount; i++)
+            if(data[10 + i] <= AtomType.H)
+                return false;
+
+        if(xBondCount == 0)
+            return true;
+
+        byte type = data[10 + xAtomCount + 3];
+
+        return type >= BondType.SINGLE && type <= BondType.SEXTUPLE || type == BondType.AROMATIC;
+    }
+
+
+    // tests whether the target contains the atom or the bond of an elementary query
+    public static boolean containsElementary(byte[] query, byte[] data, int offset)
+    {
+        int qxAtomCount = Byte.toUnsignedInt(query[0]) << 8 | Byte.toUnsignedInt(query[1]);
+        int qxBondCount = Byte.toUnsignedInt(query[6]) << 8 | Byte.toUnsignedInt(query[7]);
+
+        byte number0 = qxAtomCount > 0 ? query[10] : AtomType.C;
+        byte number1 = qxAtomCount > 1 ? query[11] : AtomType.C;
+
+        int xAtomCount = Byte.toUnsignedInt(data[offset + 0]) << 8 | Byte.toUnsignedInt(data[offset + 1]);
+        int cAtomCount = Byte.toUnsignedInt(data[offset + 2]) << 8 | Byte.toUnsignedInt(data[offset + 3]);
+        int xBondCount = Byte.toUnsignedInt(data[offset + 6]) << 8 | Byte.toUnsignedInt(data[offset + 7]);
+
+        int heavyAtomCount = xAtomCount + cAtomCount;
+        int base = offset + 10;
+
+        if(qxBondCount == 0)
+        {
+            if(number0 == AtomType.C && cAtomCount > 0)
+                return true;
+
+            for(int i = 0; i < xAtomCount; i++)
+                if(data[base + i] == number0)
+                    return true;
+
+            return false;
+        }
+
+        byte type = query[10 + qxAtomCount + 3];
+
+        for(int i = 0; i < xBondCount; i++)
+        {
+            int possition = base + xAtomCount + i * BOND_BLOCK_SIZE;
+
+            if(data[possition + 3] != type)
+                continue;
+
+            int b0 = Byte.toUnsignedInt(data[possition + 0]);
+            int b1 = Byte.toUnsignedInt(data[possition + 1]);
+            int b2 = Byte.toUnsignedInt(data[possition + 2]);
+
+            int x = b0 | (b1 << 4 & 0xF00);
+            int y = b2 | (b1 << 8 & 0xF00);
+
+            if(x >= heavyAtomCount || y >= heavyAtomCount)
+                continue;
+
+            byte numberX = x < xAtomCount ? data[base + x] : AtomType.C;
+            byte numberY = y < xAtomCount ? data[base + y] : AtomType.C;
+
+            if(numberX == number0 && numberY == number1 || numberX == number1 && numberY == number0)
+                return true;
+        }
+
+        return false;
+    }
+
+
+    // the heavy atom, heavy bond, hydrogen atom and hydrogen bond counts, as the native decoder computes them
+    public static void getSizes(byte[] data, int offset, int[] sizes)
+    {
+        int xAtomCount = Byte.toUnsignedInt(data[offset + 0]) << 8 | Byte.toUnsignedInt(data[offset + 1]);
+        int cAtomCount = Byte.toUnsignedInt(data[offset + 2]) << 8 | Byte.toUnsignedInt(data[offset + 3]);
+        int hAtomCount = Byte.toUnsignedInt(data[offset + 4]) << 8 | Byte.toUnsignedInt(data[offset + 5]);
+        int xBondCount = Byte.toUnsignedInt(data[offset + 6]) << 8 | Byte.toUnsignedInt(data[offset + 7]);
+
+        int heavyAtomCount = xAtomCount + cAtomCount;
+        int heavyBondCount = xBondCount;
+        int hydrogenBondCount = hAtomCount;
+        int possition = offset + 10 + xAtomCount;
+
+        for(int i = 0; i < xBondCount; i++, possition += BOND_BLOCK_SIZE)
+        {
+            int b0 = Byte.toUnsignedInt(data[possition + 0]);
+            int b1 = Byte.toUnsignedInt(data[possition + 1]);
+            int b2 = Byte.toUnsignedInt(data[possition + 2]);
+
+            int x = b0 | (b1 << 4 & 0xF00);
+            int y = b2 | (b1 << 8 & 0xF00);
+
+            if(x >= heavyAtomCount || y >= heavyAtomCount)
+            {
+                heavyBondCount--;
+                hydrogenBondCount++;
+            }
+        }
+
+        for(int i = 0; i < hAtomCount; i++, possition += HBOND_BLOCK_SIZE)
+            if(data[possition + 0] == 0 && data[possition + 1] == 0)
+                hydrogenBondCount--;
+
+        sizes[0] = heavyAtomCount;
+        sizes[1] = heavyBondCount;
+        sizes[2] = hAtomCount;
+        sizes[3] = hydrogenBondCount;
+    }
+
+
     @Override
     public SGroup[] getSGroups()
     {
@@ -17,27 +17,79 @@ public class NativeIsomorphism
     }
 
 
-    private final ByteBuffer implementation;
+    public static final float ITERATION_LIMIT_EXCEEDED = Float.POSITIVE_INFINITY;
+
+    final ByteBuffer implementation;
+    private ByteBuffer workspace;
 
 
     public NativeIsomorphism(byte[] query, boolean[] restH, SearchMode searchMode, ChargeMode chargeMode,
             IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode)
     {
-        implementation = create(query, restH, searchMode.ordinal(), chargeMode.ordinal(), isotopeMode.ordinal(),
-                radicalMode.ordinal(), stereoMode.ordinal());
+        this(query, restH, null, searchMode, chargeMode, isotopeMode, radicalMode, stereoMode);
+    }
+
+
+    public NativeIsomorphism(byte[] query, boolean[] restH, int[] atomWeights, SearchMode searchMode,
+            ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode)
+    {
+        implementation = create(query, restH, atomWeights, searchMode.ordinal(), chargeMode.ordinal(),
+                isotopeMode.ordinal(), radicalMode.ordinal(), stereoMode.ordinal());
+    }
+
+
+    private NativeIsomorphism(ByteBuffer implementation)
+    {
+        this.implementation = implementation;
+    }
+
+
+    // shares the native query, but not the workspace, so the fork can be used by another thread
+    public NativeIsomorphism fork()
+    {
+        return new NativeIsomorphism(implementation);
     }
 
 
-    public float match(byte[] query, long limit) throws IterationLimitExceededException
+    public float match(byte[] target, int offset, int length, long limit) throws IterationLimitExceededException
     {
-        return match(implementation, query, limit);
+        return match(implementation, target, offset, length, limit);
     }
 
 
-    private static native float match(ByteBuffer implementation, byte[] query, long limit)
+    public void match(ByteBuffer targets, int[] offsets, int count, long limit, float[] scores)
+    {
+        match(implementation, targets, offsets, count, limit, scores);
+    }
+
+
+    // returns the distinct sets of target atoms matched by the query, up to the limit, each sorted and concatenated
+    public int[] matchAll(byte[] target, int offset, int limit)
+    {
+        return matchAll(implementation, target, offset, limit);
+    }
+
+
+    public static byte[] image(byte[] molecule)
+    {
+        return createImage(molecule);
+    }
+
+
+    private native float match(ByteBuffer implementation, byte[] target, int offset, int length, long limit)
             throws IterationLimitExceededException;
 
 
-    private static native ByteBuffer create(byte[] query, boolean[] restH, int searchMode, int chargeMode,
-            int isotopeMode, int radicalMode, int stereoMode);
+    private native void match(ByteBuffer implementation, ByteBuffer targets, int[] offsets, int count, long limit,
+            float[] scores);
+
+
+    private native int[] matchAll(ByteBuffer implementation, byte[] target, int offset, int limit);
+
+
+    private static native ByteBuffer create(byte[] query, boolean[] restH, int[] atomWeights, int searchMode,
+            int chargeMode, int isotopeMode, int radicalMode, int stereoMode);
+
+
+    private static native byte[] createImage(byte[] molecule);
 }
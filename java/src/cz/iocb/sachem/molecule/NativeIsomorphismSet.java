@@ -0,0 +1,66 @@
+package cz.iocb.sachem.molecule;
+
+import java.nio.ByteBuffer;
+import cz.iocb.sachem.molecule.NativeIsomorphism.IterationLimitExceededException;
+
+
+
+public class NativeIsomorphismSet
+{
+    private final ByteBuffer[] implementations;
+    private ByteBuffer workspace;
+
+
+    public NativeIsomorphismSet(NativeIsomorphism[] isomorphisms)
+    {
+        implementations = new ByteBuffer[isomorphisms.length];
+
+        for(int i = 0; i < isomorphisms.length; i++)
+            implementations[i] = isomorphisms[i].implementation;
+    }
+
+
+    private NativeIsomorphismSet(ByteBuffer[] implementations)
+    {
+        this.implementations = implementations;
+    }
+
+
+    // shares the native queries, but not the workspace, so the fork can be used by another thread
+    public NativeIsomorphismSet fork()
+    {
+        return new NativeIsomorphismSet(implementations);
+    }
+
+
+    public float match(int[] candidates, int candidateCount, byte[] target, int offset, int length, long limit)
+            throws IterationLimitExceededException
+    {
+        return match(implementations, candidates, candidateCount, target, offset, length, limit);
+    }
+
+
+    public void match(ByteBuffer targets, int[] offsets, int[] candidateOffsets, int[] candidates, int count,
+            long limit, float[] scores)
+    {
+        match(implementations, targets, offsets, candidateOffsets, candidates, count, limit, scores);
+    }
+
+
+    // counts the distinct sets of target atoms matched by each query, up to the limit per query
+    public void matchAll(byte[] target, int offset, int limit, int[] counts)
+    {
+        matchAll(implementations, target, offset, limit, counts);
+    }
+
+
+    private native float match(ByteBuffer[] implementations, int[] candidates, int candidateCount, byte[] target,
+            int offset, int length, long limit) throws IterationLimitExceededException;
+
+
+    private native void match(ByteBuffer[] implementations, ByteBuffer targets, int[] offsets, int[] candidateOffsets,
+            int[] candidates, int count, long limit, float[] scores);
+
+
+    private native void matchAll(ByteBuffer[] implementations, byte[] target, int offset, int limit, int[] counts);
+}
@@ -0,0 +1,223 @@
+package cz.iocb.sachem.fingerprint;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Random;
+import java.util.Set;
+import java.util.stream.Collectors;
+import org.openscience.cdk.interfaces.IAtomContainer;
+import cz.iocb.sachem.molecule.BinaryMolecule;
+import cz.iocb.sachem.molecule.BinaryMoleculeBuilder;
+import cz.iocb.sachem.molecule.MoleculeCreator;
+
+
+
+/*
+ * Compares the fingerprints with the reference implementations in the baseline package, which are verbatim copies of
+ * the boxed-collection versions the stored indexes were built with. CRNG fingerprints need the native isomorphism
+ * and are not covered here.
+ */
+public class FingerprintRegressionTest
+{
+    private static final String[] molecules = {
+            "c1ccc2ccccc2c1",
+            "C1C2CC3CC1CC(C2)C3",
+            "C12C3C4C1C5C2C3C45",
+            "C[C@H](N)C(=O)O",
+            "OC[C@H]1OC(O)[C@H](O)[C@@H](O)[C@@H]1O",
+            "C[C@@H]1CC[C@H](O)CC1",
+            "C/C=C/C(=O)[O-].[Na+]",
+            "[NH3+]CC(=O)[O-]",
+            "C[N+](C)(C)CCOC(=O)c1ccccc1.[Cl-]",
+            "c1ccccc1.c1ccncc1.O",
+            "[2H]C([2H])([2H])Br",
+            "[O-][n+]1ccccc1C#N",
+            "Br",
+            "[Fe+2].[O-]C(=O)C.[O-]C(=O)C" };
+
+    private static int failures = 0;
+
+
+    private static void check(boolean condition, String message)
+    {
+        if(!condition)
+        {
+            System.err.println("FAIL: " + message);
+            failures++;
+        }
+    }
+
+
+    private static Map<Integer, Integer> asMap(IntIntMap map)
+    {
+        Map<Integer, Integer> result = new HashMap<Integer, Integer>();
+
+        for(int slot = 0; slot < map.slots(); slot++)
+            if(map.isUsed(slot))
+                result.put(map.key(slot), map.value(slot));
+
+        return result;
+    }
+
+
+    private static Set<Integer> asSet(int[] array)
+    {
+        Set<Integer> result = new HashSet<Integer>();
+
+        for(int value : array)
+            result.add(value);
+
+        return result;
+    }
+
+
+    private static void checkSubstructure(String smiles, BinaryMolecule molecule, boolean forQuery, IntIntMap counts,
+            IntSet fp)
+    {
+        String name = smiles + (forQuery ? " (query)" : "");
+
+        counts.clear();
+        fp.clear();
+
+        Set<Integer> expected = new HashSet<Integer>();
+        Map<Integer, Set<Integer>> expectedInfo = forQuery ? new HashMap<Integer, Set<Integer>>() : null;
+        Map<Integer, Set<Integer>> actualInfo = forQuery ? new HashMap<Integer, Set<Integer>>() : null;
+
+
+        Map<Integer, Set<Integer>> sgExpectedInfo = new HashMap<Integer, Set<Integer>>();
+        Map<Integer, Integer> sg = cz.iocb.sachem.fingerprint.baseline.SGFingerprint.getFingerprint(molecule, 0, 7,
+                forQuery, sgExpectedInfo);
+
+        Map<Integer, Set<Integer>> sgActualInfo = new HashMap<Integer, Set<Integer>>();
+        SGFingerprint.getFingerprint(molecule, 0, 7, forQuery, counts, sgActualInfo);
+
+        check(sg.equals(asMap(counts)), name + ": subgraph counts differ");
+        check(sgExpectedInfo.equals(sgActualInfo), name + ": subgraph atoms differ");
+
+        cz.iocb.sachem.fingerprint.baseline.IOCBFingerprint.processElements(sg, sgExpectedInfo, 1, expected, 5,
+                forQuery, expectedInfo);
+        IOCBFingerprint.processElements(counts, sgActualInfo, 1, fp, 5, forQuery, actualInfo);
+
+
+        Map<Integer, Set<Integer>> atomExpectedInfo = new HashMap<Integer, Set<Integer>>();
+        Map<Integer, Integer> atom = cz.iocb.sachem.fingerprint.baseline.AtomFingerprint.getFingerprint(molecule,
+                atomExpectedInfo);
+
+        Map<Integer, Set<Integer>> atomActualInfo = new HashMap<Integer, Set<Integer>>();
+        AtomFingerprint.getFingerprint(molecule, counts, atomActualInfo);
+
+        check(atom.equals(asMap(counts)), name + ": atom counts differ");
+        check(atomExpectedInfo.equals(atomActualInfo), name + ": atom atoms differ");
+
+        cz.iocb.sachem.fingerprint.baseline.IOCBFingerprint.processElements(atom, atomExpectedInfo, 3, expected, 5,
+                forQuery, expectedInfo);
+        IOCBFingerprint.processElements(counts, atomActualInfo, 3, fp, 5, forQuery, actualInfo);
+
+
+        check(counts.size() == 0, name + ": counts are not cleared");
+        check(expected.equals(asSet(fp.toArray())), name + ": bits differ");
+        check(fp.size() == expected.size(), name + ": bit count differs");
+
+        if(forQuery)
+            check(expectedInfo.equals(actualInfo), name + ": bit atoms differ");
+    }
+
+
+    private static void checkSimilarity(String smiles, BinaryMolecule molecule)
+    {
+        for(int minRadius = 0; minRadius <= 1; minRadius++)
+        {
+            for(int maxRadius = minRadius; maxRadius <= 4; maxRadius++)
+            {
+                List<List<Integer>> expected = cz.iocb.sachem.fingerprint.baseline.RCFingerprint
+                        .getFingerprint(molecule, minRadius, maxRadius);
+                int[][] actual = RCFingerprint.getFingerprint(molecule, minRadius, maxRadius);
+
+                List<List<Integer>> converted = new ArrayList<List<Integer>>();
+
+                for(int[] level : actual)
+                    converted.add(Arrays.stream(level).boxed().collect(Collectors.toList()));
+
+                check(expected.equals(converted),
+                        smiles + ": circular levels " + minRadius + ".." + maxRadius + " differ");
+            }
+        }
+    }
+
+
+    private static void checkCollections()
+    {
+        Random random = new Random(42);
+        IntIntMap map = new IntIntMap(4);
+        IntSet set = new IntSet(4);
+
+        for(int round = 0; round < 50; round++)
+        {
+            Map<Integer, Integer> expectedMap = new HashMap<Integer, Integer>();
+            Set<Integer> expectedSet = new HashSet<Integer>();
+
+            map.clear();
+            set.clear();
+
+            int range = 1 << random.nextInt(16);
+            int count = random.nextInt(2000);
+
+            for(int i = 0; i < count; i++)
+            {
+                int key = random.nextInt(2 * range) - range;
+                int delta = random.nextInt(10) + 1;
+
+                expectedMap.merge(key, delta, Integer::sum);
+                map.add(key, delta);
+
+                check(expectedSet.add(key) == set.add(key), "set insertion result differs for " + key);
+            }
+
+            check(expectedMap.equals(asMap(map)), "map content differs in round " + round);
+            check(expectedMap.size() == map.size(), "map size differs in round " + round);
+            check(expectedSet.equals(asSet(set.toArray())), "set content differs in round " + round);
+            check(expectedSet.size() == set.size(), "set size differs in round " + round);
+
+            for(int key = -range - 1; key <= range + 1; key += Math.max(1, range / 64))
+            {
+                check(expectedMap.getOrDefault(key, 0) == map.get(key), "map lookup differs for " + key);
+                check(expectedSet.contains(key) == set.contains(key), "set lookup differs for " + key);
+            }
+        }
+    }
+
+
+    public static void main(String[] args) throws Exception
+    {
+        checkCollections();
+
+        // the buffers are shared by all molecules in the same way as the thread-local ones of IOCBFingerprint
+        IntIntMap counts = new IntIntMap();
+        IntSet fp = new IntSet(1024);
+
+        for(String smiles : molecules)
+        {
+            IAtomContainer container = MoleculeCreator.translateMolecule(smiles, false);
+
+            BinaryMolecule indexed = new BinaryMolecule(BinaryMoleculeBuilder.asBytes(container, true));
+            checkSubstructure(smiles, indexed, false, counts, fp);
+            checkSubstructure(smiles, indexed, true, counts, fp);
+
+            BinaryMolecule query = new BinaryMolecule(BinaryMoleculeBuilder.asBytes(container, false));
+            checkSubstructure(smiles, query, true, counts, fp);
+            checkSimilarity(smiles, query);
+        }
+
+        if(failures != 0)
+        {
+            System.err.println(failures + " check(s) failed");
+            System.exit(1);
+        }
+
+        System.out.println("all fingerprint checks passed");
+    }
+}
@@ -0,0 +1,46 @@
+package cz.iocb.sachem.fingerprint.baseline;
+
+import java.util.Map;
+import java.util.Map.Entry;
+import java.util.Set;
+
+
+
+public class IOCBFingerprint extends Fingerprint
+{
+    public static final void processElements(Map<Integer, Integer> var, Map<Integer, Set<Integer>> vari, int n,
+            Set<Integer> fp, int maxFeatLogCount, boolean forQuery, Map<Integer, Set<Integer>> info)
+    {
+        for(Entry<Integer, Integer> i : var.entrySet())
+        {
+            int h = i.getKey();
+            int cnt = i.getValue();
+
+            if(forQuery)
+            {
+                int lc = 0;
+
+                for(int c = 0; cnt != 0 && c < maxFeatLogCount; c++, cnt /= 2)
+                    lc = c;
+
+                int hsh = hash(n, lc, h);
+                fp.add(hsh);
+
+                if(info != null)
+                    setInfo(info, hsh, vari.get(h));
+            }
+            else
+            {
+                for(int c = 0; cnt != 0 && c < maxFeatLogCount; c++, cnt /= 2)
+                {
+                    int hsh = hash(n, c, h);
+
+                    fp.add(hsh);
+
+                    if(info != null)
+                        setInfo(info, hsh, vari.get(h));
+                }
+            }
+        }
+    }
+}
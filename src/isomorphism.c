@@ -1,21 +1,33 @@
 #include <math.h>
+#include <pthread.h>
 #include "java.h"
 #include "molecule.h"
 #include "isomorphism.h"
 
 
 static jclass byteBufferClass;
-static jclass outOfMemoryErrorClass;
 static jclass iterationLimitExceededExceptionClass;
 static jclass queryCancelExceptionClass;
 static jmethodID allocateDirectMethod;
-static jmethodID outOfMemoryErrorConstructor;
 static jmethodID iterationLimitExceededExceptionConstructor;
 static jmethodID queryCancelExceptionConstructor;
+static jfieldID workspaceField;
+static jfieldID setWorkspaceField;
 
 
-static jobject JNICALL native_isomorphism_create(JNIEnv *env, jclass clazz, jbyteArray queryArray,
-        jbooleanArray restHArray, jint searchMode, jint chargeMode, jint isotopeMode, jint radicalMode, jint stereoMode)
+typedef struct
+{
+    VF2State *isomorphism;
+    VF2State *extendedIsomorphism;
+    void *extensionMemory;
+    void *extensionMoleculeMemory;
+    pthread_mutex_t extensionLock;
+}
+NativeIsomorphism;
+
+
+static jobject JNICALL native_isomorphism_create(JNIEnv *env, jclass clazz, jbyteArray queryArray, jbooleanArray restHArray,
+        jintArray weightArray, jint searchMode, jint chargeMode, jint isotopeMode, jint radicalMode, jint stereoMode)
 {
     uint8_t *query = (uint8_t *) (*env)->GetByteArrayElements(env, queryArray, NULL);
 
@@ -37,16 +49,45 @@ static jobject JNICALL native_isomorphism_create(JNIEnv *env, jclass clazz, jbyt
 
     bool extended = molecule_is_extended_search_needed(query, searchMode != SEARCH_EXACT, chargeMode != CHARGE_IGNORE, isotopeMode != ISOTOPE_IGNORE, radicalMode != RADICAL_IGNORE);
 
+    int weightCount = weightArray != NULL ? (*env)->GetArrayLength(env, weightArray) : 0;
+
+    /*
+    The hydrogen-extended query is only needed for targets with special hydrogens. It does not depend
+    on the target, so space for it is reserved here and it is built on the first such target.
+    */
+    bool extensible = !extended && (query[4] << 8 | query[5]) > 0;
+
+    size_t nativesize = align_size(sizeof(NativeIsomorphism));
     size_t isosize = vf2state_mem_size(query, extended);
     size_t molsize = molecule_mem_size(query, restH, extended, chargeMode != CHARGE_IGNORE, isotopeMode != ISOTOPE_IGNORE, radicalMode != RADICAL_IGNORE, stereoMode != STEREO_IGNORE, true, false, false, false);
+    size_t weightsize = align_size(weightCount * sizeof(int32_t));
+    size_t extisosize = extensible ? vf2state_mem_size(query, true) : 0;
+    size_t extmolsize = extensible ? molecule_mem_size(query, restH, true, chargeMode != CHARGE_IGNORE, isotopeMode != ISOTOPE_IGNORE, radicalMode != RADICAL_IGNORE, stereoMode != STEREO_IGNORE, true, false, false, false) : 0;
 
-    jobject buffer = (*env)->CallStaticObjectMethod(env, byteBufferClass, allocateDirectMethod, (jint) (isosize + molsize));
+    jobject buffer = (*env)->CallStaticObjectMethod(env, byteBufferClass, allocateDirectMethod,
+            (jint) (nativesize + isosize + molsize + weightsize + extisosize + extmolsize));
 
     if(likely(!(*env)->ExceptionCheck(env)))
     {
         void *memory = (*env)->GetDirectBufferAddress(env, buffer);
-        Molecule *molecule = molecule_create(memory + isosize, query, restH, extended, chargeMode != CHARGE_IGNORE, isotopeMode != ISOTOPE_IGNORE, radicalMode != RADICAL_IGNORE, stereoMode != STEREO_IGNORE, true, false, false, false);
-        vf2state_create(memory, molecule, searchMode, chargeMode, isotopeMode, radicalMode, stereoMode);
+        NativeIsomorphism *native = (NativeIsomorphism *) memory;
+        int32_t *weights = NULL;
+
+        memory += nativesize;
+
+        if(weightArray != NULL)
+        {
+            weights = (int32_t *) (memory + isosize + molsize);
+            (*env)->GetIntArrayRegion(env, weightArray, 0, weightCount, (jint *) weights);
+        }
+
+        Molecule *molecule = molecule_create(memory + isosize, query, restH, extended, chargeMode != CHARGE_IGNORE, isotopeMode != ISOTOPE_IGNORE, radicalMode != RADICAL_IGNORE, stereoMode != STEREO_IGNORE, true, false, false, false, false);
+
+        native->isomorphism = vf2state_create(memory, molecule, weights, weightCount, searchMode, chargeMode, isotopeMode, radicalMode, stereoMode);
+        native->extendedIsomorphism = NULL;
+        native->extensionMemory = extensible ? memory + isosize + molsize + weightsize : NULL;
+        native->extensionMoleculeMemory = extensible ? memory + isosize + molsize + weightsize + extisosize : NULL;
+        pthread_mutex_init(&native->extensionLock, NULL);
     }
 
     (*env)->ReleaseByteArrayElements(env, queryArray, (jbyte *) query, JNI_ABORT);
@@ -58,114 +99,784 @@ static jobject JNICALL native_isomorphism_create(JNIEnv *env, jclass clazz, jbyt
 }
 
 
-static jfloat JNICALL native_isomorphism_match(JNIEnv *env, jclass clazz, jobject buffer, jbyteArray targetArray, jlong limit)
+static jbyteArray JNICALL native_isomorphism_create_image(JNIEnv *env, jclass clazz, jbyteArray moleculeArray)
 {
-    VF2State *isomorphism = (VF2State *) (*env)->GetDirectBufferAddress(env, buffer);
-    uint8_t *target = (uint8_t *) (*env)->GetByteArrayElements(env, targetArray, NULL);
+    jsize length = (*env)->GetArrayLength(env, moleculeArray);
+    uint8_t *data = (uint8_t *) (*env)->GetPrimitiveArrayCritical(env, moleculeArray, NULL);
 
-    if(unlikely(target == NULL))
-    {
-        jobject error = (*env)->NewObject(env, outOfMemoryErrorClass, outOfMemoryErrorConstructor);
+    if(unlikely(data == NULL))
+        return NULL;
 
-        if(!(*env)->ExceptionCheck(env))
-            (*env)->Throw(env, error);
+    size_t size = molecule_image_size(data, length);
 
-        return -INFINITY;
+    (*env)->ReleasePrimitiveArrayCritical(env, moleculeArray, data, JNI_ABORT);
+
+    if(size == 0)
+        return NULL;
+
+    jbyteArray imageArray = (*env)->NewByteArray(env, size);
+
+    if(unlikely(imageArray == NULL))
+        return NULL;
+
+    uint8_t *image = (uint8_t *) (*env)->GetPrimitiveArrayCritical(env, imageArray, NULL);
+    data = (uint8_t *) (*env)->GetPrimitiveArrayCritical(env, moleculeArray, NULL);
+
+    if(likely(image != NULL && data != NULL))
+        molecule_image_create(image, data, length);
+
+    if(data != NULL)
+        (*env)->ReleasePrimitiveArrayCritical(env, moleculeArray, data, JNI_ABORT);
+
+    if(image != NULL)
+        (*env)->ReleasePrimitiveArrayCritical(env, imageArray, image, 0);
+
+    return image != NULL && data != NULL ? imageArray : NULL;
+}
+
+
+static void *native_isomorphism_get_workspace(JNIEnv *env, jobject object, jfieldID field, size_t size, size_t *capacity)
+{
+    jobject workspace = (*env)->GetObjectField(env, object, field);
+
+    if(likely(workspace != NULL && (*env)->GetDirectBufferCapacity(env, workspace) >= size))
+    {
+        *capacity = (*env)->GetDirectBufferCapacity(env, workspace);
+        return (*env)->GetDirectBufferAddress(env, workspace);
     }
 
-    if(isomorphism->searchMode == SEARCH_EXACT && isomorphism->query->sgroups == NULL && molecule_has_sgroup(target))
-        return NAN;
+    *capacity = 4096;
 
-    bool extend = !isomorphism->query->extended && isomorphism->query->hydrogenAtomCount &&
+    while(*capacity < size)
+        *capacity *= 2;
+
+    if(workspace != NULL)
+        (*env)->DeleteLocalRef(env, workspace);
+
+    workspace = (*env)->CallStaticObjectMethod(env, byteBufferClass, allocateDirectMethod, (jint) *capacity);
+
+    if(unlikely((*env)->ExceptionCheck(env)))
+        return NULL;
+
+    (*env)->SetObjectField(env, object, field, workspace);
+    return (*env)->GetDirectBufferAddress(env, workspace);
+}
+
+
+static bool native_isomorphism_needs_extension(const VF2State *isomorphism, const uint8_t *target)
+{
+    return !isomorphism->query->extended && isomorphism->query->hydrogenAtomCount &&
             (molecule_has_multivalent_hydrogen(target) ||
                     (isomorphism->searchMode == SEARCH_EXACT && (
                             (isomorphism->chargeMode == CHARGE_DEFAULT_AS_UNCHARGED && molecule_has_charged_hydrogen(target)) ||
                             (isomorphism->isotopeMode == ISOTOPE_DEFAULT_AS_STANDARD && molecule_has_hydrogen_isotope(target)) ||
                             (isomorphism->radicalMode == RADICAL_DEFAULT_AS_STANDARD && molecule_has_hydrogen_radical(target)))));
+}
+
 
-    size_t targetsize = molecule_mem_size(target, NULL, extend || isomorphism->query->extended,
+static size_t native_isomorphism_target_mem_size(const VF2State *isomorphism, const uint8_t *target, bool extend)
+{
+    return molecule_mem_size(target, NULL, extend || isomorphism->query->extended,
             isomorphism->chargeMode != CHARGE_IGNORE, isomorphism->isotopeMode != ISOTOPE_IGNORE, isomorphism->radicalMode != RADICAL_IGNORE,
             isomorphism->stereoMode != STEREO_IGNORE, isomorphism->searchMode == SEARCH_EXACT || isomorphism->query->sgroups != NULL,
             isomorphism->chargeMode == CHARGE_DEFAULT_AS_UNCHARGED, isomorphism->isotopeMode == ISOTOPE_DEFAULT_AS_STANDARD,
             isomorphism->radicalMode == RADICAL_DEFAULT_AS_STANDARD);
+}
 
-    size_t isosize = extend ? vf2state_extended_mem_size(isomorphism->query) : 0;
-    size_t molsize = extend ? molecule_extended_mem_size(isomorphism->query) : 0;
-    size_t matchsize = vf2state_match_mem_size(target, isomorphism->query->extended || extend);
 
-    void *molmemory = malloc(targetsize + isosize + molsize + matchsize);
+static bool native_isomorphism_accepts_image(const VF2State *isomorphism, const uint8_t *image, bool extend)
+{
+    return image != NULL && molecule_image_is_compatible(image) && !extend && !isomorphism->query->extended &&
+            isomorphism->query->sgroups == NULL && isomorphism->chargeMode != CHARGE_DEFAULT_AS_UNCHARGED &&
+            isomorphism->isotopeMode != ISOTOPE_DEFAULT_AS_STANDARD && isomorphism->radicalMode != RADICAL_DEFAULT_AS_STANDARD;
+}
 
-    if(unlikely(molmemory == NULL))
-    {
-        (*env)->ReleaseByteArrayElements(env, targetArray, (jbyte *) target, JNI_ABORT);
 
-        jobject error = (*env)->NewObject(env, outOfMemoryErrorClass, outOfMemoryErrorConstructor);
+static size_t native_isomorphism_image_mem_size(const uint8_t *image)
+{
+    size_t memsize = align_size(sizeof(Molecule));
 
-        if(!(*env)->ExceptionCheck(env))
-            (*env)->Throw(env, error);
+    if(((uintptr_t) image & 3) != 0)
+        memsize += align_size(molecule_image_length(image));
 
-        return -INFINITY;
+    return memsize;
+}
+
+
+static Molecule *native_isomorphism_attach_image(void *memory, const uint8_t *image)
+{
+    if(unlikely(((uintptr_t) image & 3) != 0))
+    {
+        void *copy = memory + align_size(sizeof(Molecule));
+        memcpy(copy, image, molecule_image_length(image));
+        image = copy;
     }
 
-    if(extend)
+    return molecule_image_attach(memory, image);
+}
+
+
+/*
+The matchers of all threads share the native isomorphism, so the extended query is published only
+after it has been built completely.
+*/
+static const VF2State *native_isomorphism_get_extended(const NativeIsomorphism *native)
+{
+    NativeIsomorphism *shared = (NativeIsomorphism *) native;
+    VF2State *extended = __atomic_load_n(&shared->extendedIsomorphism, __ATOMIC_ACQUIRE);
+
+    if(unlikely(extended == NULL))
     {
-        Molecule *query = molecule_extend(molmemory + targetsize + isosize, isomorphism->query);
-        isomorphism = vf2state_create(molmemory + targetsize, query, isomorphism->searchMode, isomorphism->chargeMode, isomorphism->isotopeMode, isomorphism->radicalMode, isomorphism->stereoMode);
+        pthread_mutex_lock(&shared->extensionLock);
+
+        extended = shared->extendedIsomorphism;
+
+        if(extended == NULL)
+        {
+            const VF2State *isomorphism = shared->isomorphism;
+
+            Molecule *query = molecule_extend(shared->extensionMoleculeMemory, isomorphism->query);
+            extended = vf2state_create(shared->extensionMemory, query, isomorphism->queryWeights, isomorphism->queryWeightCount,
+                    isomorphism->searchMode, isomorphism->chargeMode, isomorphism->isotopeMode, isomorphism->radicalMode, isomorphism->stereoMode);
+
+            __atomic_store_n(&shared->extendedIsomorphism, extended, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(&shared->extensionLock);
     }
 
-    Molecule *molecule = molecule_create(molmemory, target, NULL, isomorphism->query->extended,
+    return extended;
+}
+
+
+static const VF2State *native_isomorphism_select(const NativeIsomorphism *native, const uint8_t *target, const uint8_t *image, bool *attach)
+{
+    bool extend = native_isomorphism_needs_extension(native->isomorphism, target);
+
+    *attach = native_isomorphism_accepts_image(native->isomorphism, image, extend);
+
+    return extend ? native_isomorphism_get_extended(native) : native->isomorphism;
+}
+
+
+static bool native_isomorphism_is_feasible(const VF2State *isomorphism, const uint8_t *target)
+{
+    if(isomorphism->searchMode == SEARCH_EXACT && isomorphism->query->sgroups == NULL && molecule_has_sgroup(target))
+        return false;
+
+    return vf2state_is_composition_feasible(isomorphism, target);
+}
+
+
+static size_t native_isomorphism_molecule_size(const VF2State *isomorphism, const uint8_t *target, const uint8_t *image, bool attach)
+{
+    return attach ? native_isomorphism_image_mem_size(image) : native_isomorphism_target_mem_size(isomorphism, target, false);
+}
+
+
+static Molecule *native_isomorphism_decode(void *memory, const VF2State *isomorphism, const uint8_t *target, const uint8_t *image, bool attach)
+{
+    if(attach)
+        return native_isomorphism_attach_image(memory, image);
+
+    return molecule_create(memory, target, NULL, isomorphism->query->extended,
             isomorphism->chargeMode != CHARGE_IGNORE, isomorphism->isotopeMode != ISOTOPE_IGNORE,
             isomorphism->radicalMode != RADICAL_IGNORE, isomorphism->stereoMode != STEREO_IGNORE,
             isomorphism->searchMode == SEARCH_EXACT || isomorphism->query->sgroups != NULL,
             isomorphism->chargeMode == CHARGE_DEFAULT_AS_UNCHARGED, isomorphism->isotopeMode == ISOTOPE_DEFAULT_AS_STANDARD,
-            isomorphism->radicalMode == RADICAL_DEFAULT_AS_STANDARD);
+            isomorphism->radicalMode == RADICAL_DEFAULT_AS_STANDARD, true);
+}
 
-    (*env)->ReleaseByteArrayElements(env, targetArray, (jbyte *) target, JNI_ABORT);
 
-    float score = NAN;
+static bool native_isomorphism_shares_decoding(const VF2State *isomorphism, bool attach, const VF2State *other, bool otherAttach)
+{
+    return attach == otherAttach && isomorphism->query->extended == other->query->extended &&
+            (isomorphism->query->sgroups != NULL) == (other->query->sgroups != NULL) &&
+            isomorphism->searchMode == other->searchMode && isomorphism->chargeMode == other->chargeMode &&
+            isomorphism->isotopeMode == other->isotopeMode && isomorphism->radicalMode == other->radicalMode &&
+            isomorphism->stereoMode == other->stereoMode;
+}
+
+
+static float native_isomorphism_score(const VF2State *isomorphism, const Molecule *molecule)
+{
+    double heavyAtom = molecule->heavyAtomCount ? isomorphism->query->heavyAtomCount / (double) molecule->heavyAtomCount : 1.0;
+    double hydrogenAtom = molecule->hydrogenAtomCount ? isomorphism->query->hydrogenAtomCount / (double) molecule->hydrogenAtomCount : 1.0;
+    double heavyBond = molecule->heavyBondCount ? isomorphism->query->heavyBondCount / (double) molecule->heavyBondCount : 1.0;
+    double hydrogenBond = molecule->hydrogenBondCount ? isomorphism->query->hydrogenBondCount / (double) molecule->hydrogenBondCount : 1.0;
+
+    return (8 * heavyAtom + 4 * heavyBond + 2 * hydrogenAtom + 1 * hydrogenBond) / 15;
+}
+
+
+static float native_isomorphism_run(const VF2State *template, Molecule *molecule, void *memory, jlong limit)
+{
+    VF2State *isomorphism = vf2state_fork(memory, template);
+
+    if(vf2state_match(isomorphism, molecule, memory + vf2state_fork_mem_size(template), limit))
+        return native_isomorphism_score(isomorphism, molecule);
+    else if(unlikely(isomorphism->counter == 0))
+        return INFINITY;
+    else if(unlikely(InterruptPending && QueryCancelPending))
+        return -INFINITY;
+
+    return NAN;
+}
+
+
+static size_t native_isomorphism_workspace_size(const NativeIsomorphism *native, const uint8_t *target)
+{
+    const uint8_t *image = NULL;
 
-    if(vf2state_match(isomorphism, molecule, molmemory + targetsize + isosize + molsize, limit))
+    if(molecule_is_image(target))
     {
-        double heavyAtom = molecule->heavyAtomCount ? isomorphism->query->heavyAtomCount / (double) molecule->heavyAtomCount : 1.0;
-        double hydrogenAtom = molecule->hydrogenAtomCount ? isomorphism->query->hydrogenAtomCount / (double) molecule->hydrogenAtomCount : 1.0;
-        double heavyBond = molecule->heavyBondCount ? isomorphism->query->heavyBondCount / (double) molecule->heavyBondCount : 1.0;
-        double hydrogenBond = molecule->hydrogenBondCount ? isomorphism->query->hydrogenBondCount / (double) molecule->hydrogenBondCount : 1.0;
+        image = target;
+        target = molecule_image_get_data(image);
+    }
+
+    bool attach;
+    const VF2State *isomorphism = native_isomorphism_select(native, target, image, &attach);
+
+    size_t targetsize = native_isomorphism_molecule_size(isomorphism, target, image, attach);
+    size_t forksize = vf2state_fork_mem_size(isomorphism);
+    size_t matchsize = vf2state_match_mem_size(target, isomorphism->query->extended);
+
+    return targetsize + forksize + matchsize;
+}
 
-        score = (8 * heavyAtom + 4 * heavyBond + 2 * hydrogenAtom + 1 * hydrogenBond) / 15;
+
+static float native_isomorphism_match_target(const NativeIsomorphism *native, const uint8_t *target, void *molmemory, jlong limit)
+{
+    const uint8_t *image = NULL;
+
+    if(molecule_is_image(target))
+    {
+        image = target;
+        target = molecule_image_get_data(image);
     }
-    else if(unlikely(isomorphism->counter == 0))
+
+    if(!native_isomorphism_is_feasible(native->isomorphism, target))
+        return NAN;
+
+    bool attach;
+    const VF2State *isomorphism = native_isomorphism_select(native, target, image, &attach);
+
+    Molecule *molecule = native_isomorphism_decode(molmemory, isomorphism, target, image, attach);
+
+    return native_isomorphism_run(isomorphism, molecule, molmemory + native_isomorphism_molecule_size(isomorphism, target, image, attach), limit);
+}
+
+
+/*
+Matches the target against alternative queries, such as the tautomers of one query, and returns the
+best score. The target is decoded once for all queries that need the same decoding, and these queries
+are tried in the order of their scores, so the search stops at the first match.
+*/
+static float native_isomorphism_match_any(const NativeIsomorphism **natives, int count, const uint8_t *target, void *molmemory, jlong limit)
+{
+    if(count == 0)
+        return NAN;
+
+    const uint8_t *image = NULL;
+
+    if(molecule_is_image(target))
     {
-        jobject exception = (*env)->NewObject(env, iterationLimitExceededExceptionClass, iterationLimitExceededExceptionConstructor);
+        image = target;
+        target = molecule_image_get_data(image);
+    }
 
-        if(!(*env)->ExceptionCheck(env))
-            (*env)->Throw(env, exception);
+    const VF2State *pending[count];
+    bool attaches[count];
+    int pendingCount = 0;
 
-        score = -INFINITY;
+    for(int i = 0; i < count; i++)
+    {
+        if(native_isomorphism_is_feasible(natives[i]->isomorphism, target))
+        {
+            pending[pendingCount] = native_isomorphism_select(natives[i], target, image, &attaches[pendingCount]);
+            pendingCount++;
+        }
     }
-    else if(unlikely(InterruptPending && QueryCancelPending))
+
+    float best = NAN;
+    bool exceeded = false;
+
+    while(pendingCount > 0)
+    {
+        const VF2State *first = pending[0];
+        bool attach = attaches[0];
+
+        Molecule *molecule = native_isomorphism_decode(molmemory, first, target, image, attach);
+        void *memory = molmemory + native_isomorphism_molecule_size(first, target, image, attach);
+
+        const VF2State *group[pendingCount];
+        float scores[pendingCount];
+        int groupCount = 0;
+        int restCount = 0;
+
+        for(int i = 0; i < pendingCount; i++)
+        {
+            if(native_isomorphism_shares_decoding(pending[i], attaches[i], first, attach))
+            {
+                float score = native_isomorphism_score(pending[i], molecule);
+                int j = groupCount++;
+
+                for(; j > 0 && scores[j - 1] < score; j--)
+                {
+                    group[j] = group[j - 1];
+                    scores[j] = scores[j - 1];
+                }
+
+                group[j] = pending[i];
+                scores[j] = score;
+            }
+            else
+            {
+                pending[restCount] = pending[i];
+                attaches[restCount++] = attaches[i];
+            }
+        }
+
+        for(int i = 0; i < groupCount && !(scores[i] <= best); i++)
+        {
+            float result = native_isomorphism_run(group[i], molecule, memory, limit);
+
+            if(unlikely(result == -INFINITY))
+                return -INFINITY;
+
+            if(unlikely(result == INFINITY))
+            {
+                exceeded = true;
+            }
+            else if(!isnan(result))
+            {
+                best = result;
+                break;
+            }
+        }
+
+        pendingCount = restCount;
+    }
+
+    if(!isnan(best))
+        return best;
+
+    return exceeded ? INFINITY : NAN;
+}
+
+
+static size_t native_isomorphism_any_workspace_size(const NativeIsomorphism **natives, int count, const uint8_t *target)
+{
+    size_t size = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+        size_t nativesize = native_isomorphism_workspace_size(natives[i], target);
+
+        if(nativesize > size)
+            size = nativesize;
+    }
+
+    return size;
+}
+
+
+static size_t native_isomorphism_all_workspace_size(const NativeIsomorphism **natives, int count, const uint8_t *target, int limit)
+{
+    const VF2State *decoded = NULL;
+    size_t targetsize = 0;
+    size_t size = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+        bool attach;
+        const VF2State *isomorphism = native_isomorphism_select(natives[i], target, NULL, &attach);
+
+        if(decoded == NULL || !native_isomorphism_shares_decoding(isomorphism, false, decoded, false))
+        {
+            decoded = isomorphism;
+            targetsize = native_isomorphism_molecule_size(isomorphism, target, NULL, false);
+        }
+
+        size_t nativesize = targetsize + vf2state_fork_mem_size(isomorphism) +
+                vf2state_match_mem_size(target, isomorphism->query->extended) +
+                align_size((size_t) limit * isomorphism->queryAtomCount * sizeof(AtomIdx));
+
+        if(nativesize > size)
+            size = nativesize;
+    }
+
+    return size;
+}
+
+
+static int native_isomorphism_run_all(const VF2State *template, Molecule *molecule, void *memory, int limit, AtomIdx **matches)
+{
+    VF2State *isomorphism = vf2state_fork(memory, template);
+    memory += vf2state_fork_mem_size(template);
+
+    *matches = (AtomIdx *) alloc_memory(&memory, (size_t) limit * template->queryAtomCount * sizeof(AtomIdx));
+
+    int count = vf2state_match_all(isomorphism, molecule, memory, 0, *matches, limit);
+
+    if(unlikely(InterruptPending && QueryCancelPending))
+        return -1;
+
+    return count;
+}
+
+
+/*
+Counts the distinct matches of each query in the target, as needed for fingerprints based on a
+set of patterns. Most patterns are rejected by the screen of the target, the others share one
+decoding of the target as long as they need the same decoding.
+*/
+static bool native_isomorphism_match_all(const NativeIsomorphism **natives, int count, const uint8_t *target, void *molmemory,
+        int limit, jint *counts)
+{
+    const VF2State *decoded = NULL;
+    Molecule *molecule = NULL;
+    void *memory = NULL;
+
+    VF2Screen screen;
+    vf2screen_create(&screen, target);
+
+    for(int i = 0; i < count; i++)
+    {
+        counts[i] = 0;
+
+        if(!vf2state_is_screen_feasible(natives[i]->isomorphism, &screen) ||
+                !native_isomorphism_is_feasible(natives[i]->isomorphism, target))
+            continue;
+
+        bool attach;
+        const VF2State *isomorphism = native_isomorphism_select(natives[i], target, NULL, &attach);
+
+        if(decoded == NULL || !native_isomorphism_shares_decoding(isomorphism, false, decoded, false))
+        {
+            decoded = isomorphism;
+            molecule = native_isomorphism_decode(molmemory, isomorphism, target, NULL, false);
+            memory = molmemory + native_isomorphism_molecule_size(isomorphism, target, NULL, false);
+        }
+
+        AtomIdx *matches;
+        counts[i] = native_isomorphism_run_all(isomorphism, molecule, memory, limit, &matches);
+
+        if(unlikely(counts[i] < 0))
+            return false;
+    }
+
+    return true;
+}
+
+
+static void native_isomorphism_throw_cancel(JNIEnv *env)
+{
+    jobject exception = (*env)->NewObject(env, queryCancelExceptionClass, queryCancelExceptionConstructor);
+
+    if(!(*env)->ExceptionCheck(env))
+        (*env)->Throw(env, exception);
+}
+
+
+static jfloat native_isomorphism_match_array(JNIEnv *env, jobject object, jfieldID field, const NativeIsomorphism **natives, int count,
+        jbyteArray targetArray, jint offset, jint length, jlong limit)
+{
+    /* the target is copied to the head of the workspace, so the search does not block the garbage collector */
+    size_t targetsize = align_size(length);
+
+    size_t capacity;
+    uint8_t *target = (uint8_t *) native_isomorphism_get_workspace(env, object, field, targetsize, &capacity);
+
+    if(unlikely(target == NULL))
+        return -INFINITY;
+
+    (*env)->GetByteArrayRegion(env, targetArray, offset, length, (jbyte *) target);
+
+    if(unlikely((*env)->ExceptionCheck(env)))
+        return -INFINITY;
+
+    size_t size = targetsize + (count == 1 ? native_isomorphism_workspace_size(natives[0], target) :
+            native_isomorphism_any_workspace_size(natives, count, target));
+
+    if(unlikely(size > capacity))
+    {
+        target = (uint8_t *) native_isomorphism_get_workspace(env, object, field, size, &capacity);
+
+        if(unlikely(target == NULL))
+            return -INFINITY;
+
+        (*env)->GetByteArrayRegion(env, targetArray, offset, length, (jbyte *) target);
+    }
+
+    void *molmemory = target + targetsize;
+
+    float score = count == 1 ? native_isomorphism_match_target(natives[0], target, molmemory, limit) :
+            native_isomorphism_match_any(natives, count, target, molmemory, limit);
+
+    if(unlikely(score == INFINITY))
     {
-        jobject exception = (*env)->NewObject(env, queryCancelExceptionClass, queryCancelExceptionConstructor);
+        jobject exception = (*env)->NewObject(env, iterationLimitExceededExceptionClass, iterationLimitExceededExceptionConstructor);
 
         if(!(*env)->ExceptionCheck(env))
             (*env)->Throw(env, exception);
 
         score = -INFINITY;
     }
+    else if(unlikely(score == -INFINITY))
+    {
+        native_isomorphism_throw_cancel(env);
+    }
 
-    free(molmemory);
     return score;
 }
 
 
-void isomorphism_init()
+static jfloat JNICALL native_isomorphism_match(JNIEnv *env, jobject object, jobject buffer, jbyteArray targetArray, jint offset,
+        jint length, jlong limit)
 {
-    outOfMemoryErrorClass = (jclass) (*env)->NewGlobalRef(env, (*env)->FindClass(env, "java/lang/OutOfMemoryError"));
-    java_check_exception(__func__);
+    const NativeIsomorphism *native = (const NativeIsomorphism *) (*env)->GetDirectBufferAddress(env, buffer);
 
-    outOfMemoryErrorConstructor = (*env)->GetMethodID(env, outOfMemoryErrorClass, "<init>", "()V");
-    java_check_exception(__func__);
+    return native_isomorphism_match_array(env, object, workspaceField, &native, 1, targetArray, offset, length, limit);
+}
 
 
+static void JNICALL native_isomorphism_match_batch(JNIEnv *env, jobject object, jobject buffer, jobject targetBuffer,
+        jintArray offsetArray, jint count, jlong limit, jfloatArray scoreArray)
+{
+    const NativeIsomorphism *native = (const NativeIsomorphism *) (*env)->GetDirectBufferAddress(env, buffer);
+    uint8_t *targets = (uint8_t *) (*env)->GetDirectBufferAddress(env, targetBuffer);
+
+    jint offsets[count];
+    jfloat scores[count];
+
+    (*env)->GetIntArrayRegion(env, offsetArray, 0, count, offsets);
+
+    if(unlikely((*env)->ExceptionCheck(env)))
+        return;
+
+    size_t capacity = 0;
+    void *molmemory = NULL;
+
+    for(int i = 0; i < count; i++)
+    {
+        size_t size = native_isomorphism_workspace_size(native, targets + offsets[i]);
+
+        if(unlikely(size > capacity))
+        {
+            molmemory = native_isomorphism_get_workspace(env, object, workspaceField, size, &capacity);
+
+            if(unlikely(molmemory == NULL))
+                return;
+        }
+
+        scores[i] = native_isomorphism_match_target(native, targets + offsets[i], molmemory, limit);
+
+        if(unlikely(scores[i] == -INFINITY))
+        {
+            native_isomorphism_throw_cancel(env);
+            return;
+        }
+    }
+
+    (*env)->SetFloatArrayRegion(env, scoreArray, 0, count, scores);
+}
+
+
+static jintArray JNICALL native_isomorphism_match_all_atoms(JNIEnv *env, jobject object, jobject buffer, jbyteArray targetArray,
+        jint offset, jint limit)
+{
+    const NativeIsomorphism *native = (const NativeIsomorphism *) (*env)->GetDirectBufferAddress(env, buffer);
+    uint8_t *target = (uint8_t *) (*env)->GetByteArrayElements(env, targetArray, NULL);
+
+    if(unlikely(target == NULL))
+        return NULL;
+
+    size_t capacity;
+    void *molmemory = native_isomorphism_get_workspace(env, object, workspaceField,
+            native_isomorphism_all_workspace_size(&native, 1, target + offset, limit), &capacity);
+
+    jintArray result = NULL;
+
+    if(likely(molmemory != NULL))
+    {
+        int count = 0;
+        AtomIdx *matches = NULL;
+        const VF2State *isomorphism = native->isomorphism;
+
+        if(native_isomorphism_is_feasible(native->isomorphism, target + offset))
+        {
+            bool attach;
+            isomorphism = native_isomorphism_select(native, target + offset, NULL, &attach);
+
+            Molecule *molecule = native_isomorphism_decode(molmemory, isomorphism, target + offset, NULL, false);
+            void *memory = molmemory + native_isomorphism_molecule_size(isomorphism, target + offset, NULL, false);
+
+            count = native_isomorphism_run_all(isomorphism, molecule, memory, limit, &matches);
+        }
+
+        if(unlikely(count < 0))
+        {
+            native_isomorphism_throw_cancel(env);
+        }
+        else
+        {
+            int length = count * isomorphism->queryAtomCount;
+            result = (*env)->NewIntArray(env, length);
+
+            jint *atoms = result != NULL ? (jint *) (*env)->GetPrimitiveArrayCritical(env, result, NULL) : NULL;
+
+            if(likely(atoms != NULL))
+            {
+                for(int i = 0; i < length; i++)
+                    atoms[i] = matches[i];
+
+                (*env)->ReleasePrimitiveArrayCritical(env, result, atoms, 0);
+            }
+        }
+    }
+
+    (*env)->ReleaseByteArrayElements(env, targetArray, (jbyte *) target, JNI_ABORT);
+
+    return result;
+}
+
+
+static bool native_isomorphism_set_resolve(JNIEnv *env, jobjectArray implementationArray, const jint *indices, int count,
+        const NativeIsomorphism **natives)
+{
+    for(int i = 0; i < count; i++)
+    {
+        jobject buffer = (*env)->GetObjectArrayElement(env, implementationArray, indices != NULL ? indices[i] : i);
+
+        if(unlikely((*env)->ExceptionCheck(env)))
+            return false;
+
+        natives[i] = (const NativeIsomorphism *) (*env)->GetDirectBufferAddress(env, buffer);
+        (*env)->DeleteLocalRef(env, buffer);
+    }
+
+    return true;
+}
+
+
+static jfloat JNICALL native_isomorphism_set_match(JNIEnv *env, jobject object, jobjectArray implementationArray, jintArray candidateArray,
+        jint candidateCount, jbyteArray targetArray, jint offset, jint length, jlong limit)
+{
+    if(candidateCount == 0)
+        return NAN;
+
+    jint candidates[candidateCount];
+    const NativeIsomorphism *natives[candidateCount];
+
+    (*env)->GetIntArrayRegion(env, candidateArray, 0, candidateCount, candidates);
+
+    if(unlikely((*env)->ExceptionCheck(env)))
+        return -INFINITY;
+
+    if(unlikely(!native_isomorphism_set_resolve(env, implementationArray, candidates, candidateCount, natives)))
+        return -INFINITY;
+
+    return native_isomorphism_match_array(env, object, setWorkspaceField, natives, candidateCount, targetArray, offset, length, limit);
+}
+
+
+static void JNICALL native_isomorphism_set_match_batch(JNIEnv *env, jobject object, jobjectArray implementationArray, jobject targetBuffer,
+        jintArray offsetArray, jintArray candidateOffsetArray, jintArray candidateArray, jint count, jlong limit, jfloatArray scoreArray)
+{
+    uint8_t *targets = (uint8_t *) (*env)->GetDirectBufferAddress(env, targetBuffer);
+    int implementationCount = (*env)->GetArrayLength(env, implementationArray);
+
+    jint offsets[count];
+    jint candidateOffsets[count + 1];
+    jfloat scores[count];
+    const NativeIsomorphism *natives[implementationCount];
+
+    (*env)->GetIntArrayRegion(env, offsetArray, 0, count, offsets);
+    (*env)->GetIntArrayRegion(env, candidateOffsetArray, 0, count + 1, candidateOffsets);
+
+    if(unlikely((*env)->ExceptionCheck(env)))
+        return;
+
+    if(unlikely(!native_isomorphism_set_resolve(env, implementationArray, NULL, implementationCount, natives)))
+        return;
+
+    jint *candidates = (*env)->GetIntArrayElements(env, candidateArray, NULL);
+
+    if(unlikely(candidates == NULL))
+        return;
+
+    size_t capacity = 0;
+    void *molmemory = NULL;
+
+    for(int i = 0; i < count; i++)
+    {
+        int candidateCount = candidateOffsets[i + 1] - candidateOffsets[i];
+        const NativeIsomorphism *selected[candidateCount + 1];
+
+        for(int j = 0; j < candidateCount; j++)
+            selected[j] = natives[candidates[candidateOffsets[i] + j]];
+
+        size_t size = native_isomorphism_any_workspace_size(selected, candidateCount, targets + offsets[i]);
+
+        if(unlikely(size > capacity))
+        {
+            molmemory = native_isomorphism_get_workspace(env, object, setWorkspaceField, size, &capacity);
+
+            if(unlikely(molmemory == NULL))
+                break;
+        }
+
+        scores[i] = native_isomorphism_match_any(selected, candidateCount, targets + offsets[i], molmemory, limit);
+
+        if(unlikely(scores[i] == -INFINITY))
+        {
+            native_isomorphism_throw_cancel(env);
+            break;
+        }
+    }
+
+    (*env)->ReleaseIntArrayElements(env, candidateArray, candidates, JNI_ABORT);
+
+    if(likely(!(*env)->ExceptionCheck(env)))
+        (*env)->SetFloatArrayRegion(env, scoreArray, 0, count, scores);
+}
+
+
+static void JNICALL native_isomorphism_set_match_all(JNIEnv *env, jobject object, jobjectArray implementationArray,
+        jbyteArray targetArray, jint offset, jint limit, jintArray countArray)
+{
+    int count = (*env)->GetArrayLength(env, implementationArray);
+
+    const NativeIsomorphism *natives[count];
+    jint counts[count];
+
+    if(unlikely(!native_isomorphism_set_resolve(env, implementationArray, NULL, count, natives)))
+        return;
+
+    uint8_t *target = (uint8_t *) (*env)->GetByteArrayElements(env, targetArray, NULL);
+
+    if(unlikely(target == NULL))
+        return;
+
+    size_t capacity;
+    void *molmemory = native_isomorphism_get_workspace(env, object, setWorkspaceField,
+            native_isomorphism_all_workspace_size(natives, count, target + offset, limit), &capacity);
+
+    if(likely(molmemory != NULL))
+    {
+        if(native_isomorphism_match_all(natives, count, target + offset, molmemory, limit, counts))
+            (*env)->SetIntArrayRegion(env, countArray, 0, count, counts);
+        else
+            native_isomorphism_throw_cancel(env);
+    }
+
+    (*env)->ReleaseByteArrayElements(env, targetArray, (jbyte *) target, JNI_ABORT);
+}
+
+
+void isomorphism_init()
+{
     iterationLimitExceededExceptionClass = (jclass) (*env)->NewGlobalRef(env, (*env)->FindClass(env, "cz/iocb/sachem/molecule/NativeIsomorphism$IterationLimitExceededException"));
     java_check_exception(__func__);
 
@@ -190,21 +901,69 @@ void isomorphism_init()
     jclass nativeIsomorphismClass = (*env)->FindClass(env, "cz/iocb/sachem/molecule/NativeIsomorphism");
     java_check_exception(__func__);
 
+    workspaceField = (*env)->GetFieldID(env, nativeIsomorphismClass, "workspace", "Ljava/nio/ByteBuffer;");
+    java_check_exception(__func__);
+
 
     JNINativeMethod methods[] =
     {
         {
             "create",
-            "([B[ZIIIII)Ljava/nio/ByteBuffer;",
+            "([B[Z[IIIIII)Ljava/nio/ByteBuffer;",
             native_isomorphism_create
         },
         {
             "match",
-            "(Ljava/nio/ByteBuffer;[BJ)F",
+            "(Ljava/nio/ByteBuffer;[BIIJ)F",
             native_isomorphism_match
+        },
+        {
+            "match",
+            "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;[IIJ[F)V",
+            native_isomorphism_match_batch
+        },
+        {
+            "createImage",
+            "([B)[B",
+            native_isomorphism_create_image
+        },
+        {
+            "matchAll",
+            "(Ljava/nio/ByteBuffer;[BII)[I",
+            native_isomorphism_match_all_atoms
+        }
+    };
+
+    if((*env)->RegisterNatives(env, nativeIsomorphismClass, methods, 5) != 0)
+        elog(ERROR, "cannot register native methods");
+
+
+    jclass nativeIsomorphismSetClass = (*env)->FindClass(env, "cz/iocb/sachem/molecule/NativeIsomorphismSet");
+    java_check_exception(__func__);
+
+    setWorkspaceField = (*env)->GetFieldID(env, nativeIsomorphismSetClass, "workspace", "Ljava/nio/ByteBuffer;");
+    java_check_exception(__func__);
+
+
+    JNINativeMethod setMethods[] =
+    {
+        {
+            "match",
+            "([Ljava/nio/ByteBuffer;[II[BIIJ)F",
+            native_isomorphism_set_match
+        },
+        {
+            "match",
+            "([Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;[I[I[IIJ[F)V",
+            native_isomorphism_set_match_batch
+        },
+        {
+            "matchAll",
+            "([Ljava/nio/ByteBuffer;[BII[I)V",
+            native_isomorphism_set_match_all
         }
     };
 
-    if((*env)->RegisterNatives(env, nativeIsomorphismClass, methods, 2) != 0)
+    if((*env)->RegisterNatives(env, nativeIsomorphismSetClass, setMethods, 3) != 0)
         elog(ERROR, "cannot register native methods");
 }
@@ -41,6 +41,11 @@
 #define UNDEFINED_CORE              -1
 #define is_core_defined(value)      ((value) >= 0)
 
+#define VF2_MASK_BITS               128
+#define VF2_PLAIN_ITERATIONS        1024
+#define VF2_SGROUP_BITS             64
+#define VF2_SCREEN_BOND_TYPES       (BOND_AROMATIC + 1)
+
 
 typedef enum
 {
@@ -94,6 +99,26 @@ VF2Undo;
 
 
 typedef struct
+{
+    uint64_t words[VF2_MASK_BITS / 64];
+}
+VF2Mask;
+
+
+typedef struct
+{
+    int atomCount;
+    int xAtomCount;
+    int cAtomCount;
+    int ringCount;
+    uint64_t bondFeatures;
+    MolSize elementCounts[256];
+    MolSize bondTypeCounts[VF2_SCREEN_BOND_TYPES];
+}
+VF2Screen;
+
+
+typedef struct VF2State
 {
     uint64_t counter;
 
@@ -104,7 +129,7 @@ typedef struct
     StereoMode stereoMode;
 
     const Molecule *restrict query;
-    const Molecule *restrict target;
+    Molecule *restrict target;
 
     int queryAtomCount;
     int targetAtomCount;
@@ -117,14 +142,117 @@ typedef struct
     AtomIdx *restrict queryParents;
     AtomIdx queryIdx;
 
+    const int32_t *restrict queryWeights;
+    int queryWeightCount;
+
+    int queryCAtomCount;
+    int queryXBondCount;
+    int queryFixedXAtomCount;
+    int queryChargedAtomCount;
+    int queryIsotopeAtomCount;
+    int queryElementCount;
+    int8_t *restrict queryElementNumbers;
+    MolSize *restrict queryElementCounts;
+    int queryRingCount;
+    uint64_t queryBondFeatures;
+    MolSize queryBondTypeCounts[VF2_SCREEN_BOND_TYPES];
+
     AtomIdx targetSelector;
     AtomIdx targetIdx;
 
     VF2Undo *restrict undos;
+
+    int *restrict stereoCheckOffsets;
+    int *restrict stereoChecks;
+
+    bool sgroupPruning;
+    uint64_t *restrict querySGroupAtoms;
+    uint64_t *restrict querySGroupBonds;
+    uint64_t *restrict targetSGroupAtoms;
+    uint64_t *restrict sgroupCandidates;
+
+    bool bitParallel;
+    VF2Mask *restrict queryDomains;
+    bool *restrict queryDomainReady;
+    VF2Mask *restrict targetAdjacency;
+    VF2Mask targetMapped;
+
+    bool (*matchCore)(struct VF2State *restrict vf2state);
 }
 VF2State;
 
 
+static inline void vf2mask_set(VF2Mask *restrict mask, int bit)
+{
+    mask->words[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+}
+
+
+static inline void vf2mask_clear(VF2Mask *restrict mask, int bit)
+{
+    mask->words[bit >> 6] &= ~((uint64_t) 1 << (bit & 63));
+}
+
+
+static inline bool vf2mask_test(const VF2Mask *restrict mask, int bit)
+{
+    return mask->words[bit >> 6] >> (bit & 63) & 1;
+}
+
+
+static inline int vf2mask_next(const VF2Mask *restrict mask, int bit)
+{
+    for(int w = bit >> 6; w < VF2_MASK_BITS / 64; w++)
+    {
+        uint64_t word = mask->words[w];
+
+        if(w == bit >> 6)
+            word &= ~(uint64_t) 0 << (bit & 63);
+
+        if(word != 0)
+            return (w << 6) + __builtin_ctzll(word);
+    }
+
+    return -1;
+}
+
+
+static inline bool vf2state_match_core_substructure(VF2State *restrict vf2state);
+static inline bool vf2state_match_core_exact(VF2State *restrict vf2state);
+static inline bool vf2state_match_core_generic(VF2State *restrict vf2state);
+
+
+static inline int find_component(int *restrict components, int atom)
+{
+    while(components[atom] != atom)
+        atom = components[atom] = components[components[atom]];
+
+    return atom;
+}
+
+
+static inline bool join_components(int *restrict components, int atom0, int atom1)
+{
+    atom0 = find_component(components, atom0);
+    atom1 = find_component(components, atom1);
+
+    if(atom0 == atom1)
+        return false;
+
+    components[atom0] = atom1;
+    return true;
+}
+
+
+static inline uint64_t bond_feature(int8_t number0, int8_t number1, uint8_t type)
+{
+    uint8_t low = (uint8_t) (number0 < number1 ? number0 : number1);
+    uint8_t high = (uint8_t) (number0 < number1 ? number1 : number0);
+
+    return UINT64_C(1) << ((low * 31 + high) * 17 + type) % 64;
+}
+
+
 static inline void swap_idx(AtomIdx *restrict a, AtomIdx *restrict b)
 {
     AtomIdx t = *a;
@@ -200,17 +328,28 @@ static inline size_t vf2state_mem_size(const uint8_t *restrict data, bool extend
 {
     int atomCount = (*(data + 0) << 8 | *(data + 1)) + (*(data + 2) << 8 | *(data + 3));
 
+    int xAtomCount = *(data + 0) << 8 | *(data + 1);
+    int bondCount = *(data + 6) << 8 | *(data + 7);
+
     if(extended)
+    {
         atomCount += *(data + 4) << 8 | *(data + 5);
+        bondCount += *(data + 4) << 8 | *(data + 5);
+    }
 
-    return align_size(sizeof(VF2State)) + 3 * align_size(atomCount * sizeof(AtomIdx)) + align_size(atomCount * sizeof(VF2Undo));
+    return align_size(sizeof(VF2State)) + 2 * align_size(atomCount * sizeof(AtomIdx)) +
+            align_size(xAtomCount * sizeof(int8_t)) + align_size(xAtomCount * sizeof(MolSize)) +
+            align_size((atomCount + 1) * sizeof(int)) + align_size((atomCount + bondCount) * sizeof(int)) +
+            2 * align_size(atomCount * sizeof(uint64_t));
 }
 
 
-static inline size_t vf2state_extended_mem_size(const Molecule *restrict molecule)
+static inline size_t vf2state_fork_mem_size(const VF2State *restrict template)
 {
-    int atomCount = molecule->heavyAtomCount + molecule->hydrogenAtomCount;
-    return align_size(sizeof(VF2State)) + 3 * align_size(atomCount * sizeof(AtomIdx)) + align_size(atomCount * sizeof(VF2Undo));
+    int atomCount = template->queryAtomCount;
+
+    return align_size(sizeof(VF2State)) + align_size(atomCount * sizeof(AtomIdx)) + align_size(atomCount * sizeof(VF2Undo)) +
+            align_size(atomCount * sizeof(VF2Mask)) + align_size(atomCount * sizeof(bool));
 }
 
 
@@ -221,21 +360,41 @@ static inline size_t vf2state_match_mem_size(const uint8_t *restrict data, bool
     if(extended)
         atomCount += *(data + 4) << 8 | *(data + 5);
 
-    return align_size(atomCount * sizeof(AtomIdx));
+    size_t size = align_size(atomCount * sizeof(AtomIdx)) + align_size(atomCount * sizeof(uint64_t)) +
+            align_size(VF2_SGROUP_BITS * sizeof(uint64_t));
+
+    if(atomCount <= VF2_MASK_BITS)
+        size += align_size(atomCount * sizeof(VF2Mask));
+
+    return size;
+}
+
+
+static inline int32_t vf2state_query_weight(const int32_t *restrict weights, int weightCount, AtomIdx atom)
+{
+    if(weights == NULL)
+        return 0;
+
+    return atom < weightCount ? weights[atom] : INT32_MAX;
 }
 
 
-static inline VF2State *vf2state_create(void *memory, const Molecule *restrict query, SearchMode searchMode,
-        ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode, StereoMode stereoMode)
+static inline VF2State *vf2state_create(void *memory, const Molecule *restrict query, const int32_t *restrict weights,
+        int weightCount, SearchMode searchMode, ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode,
+        StereoMode stereoMode)
 {
     VF2State *restrict vf2state = (VF2State *) alloc_memory(&memory, sizeof(VF2State));
 
     int queryAtomCount = query->atomCount;
 
-    AtomIdx *restrict queryCore = (AtomIdx *) alloc_memory(&memory, queryAtomCount * sizeof(AtomIdx));
     AtomIdx *restrict queryOrder = (AtomIdx *) alloc_memory(&memory, queryAtomCount * sizeof(AtomIdx));
     AtomIdx *restrict queryParents = (AtomIdx *) alloc_memory(&memory, queryAtomCount * sizeof(AtomIdx));
-    VF2Undo *restrict undos = (VF2Undo *) alloc_memory(&memory, queryAtomCount * sizeof(VF2Undo));
+    int8_t *restrict queryElementNumbers = (int8_t *) alloc_memory(&memory, query->xAtomCount * sizeof(int8_t));
+    MolSize *restrict queryElementCounts = (MolSize *) alloc_memory(&memory, query->xAtomCount * sizeof(MolSize));
+    int *restrict stereoCheckOffsets = (int *) alloc_memory(&memory, (queryAtomCount + 1) * sizeof(int));
+    int *restrict stereoChecks = (int *) alloc_memory(&memory, (queryAtomCount + query->bondCount) * sizeof(int));
+    uint64_t *restrict querySGroupAtoms = (uint64_t *) alloc_memory(&memory, queryAtomCount * sizeof(uint64_t));
+    uint64_t *restrict querySGroupBonds = (uint64_t *) alloc_memory(&memory, queryAtomCount * sizeof(uint64_t));
 
 
     for(int i = 0; i < queryAtomCount; i++)
@@ -251,16 +410,24 @@ static inline VF2State *vf2state_create(void *memory, const Molecule *restrict q
         AtomIdx selected = -1;
         AtomIdx fallback = -1;
 
+        int32_t selectedWeight = INT32_MAX;
+        int32_t fallbackWeight = INT32_MAX;
+
         for(AtomIdx i = 0; i < queryAtomCount; i++)
         {
-            if(selected == -1 && queryFlags[i] == 1)
+            int32_t weight = vf2state_query_weight(weights, weightCount, i);
+
+            if(queryFlags[i] == 1 && (selected == -1 || weight < selectedWeight))
             {
                 selected = i;
-                break;
+                selectedWeight = weight;
             }
 
-            if(fallback == -1 && queryFlags[i] == 0)
+            if(queryFlags[i] == 0 && (fallback == -1 || weight < fallbackWeight))
+            {
                 fallback = i;
+                fallbackWeight = weight;
+            }
         }
 
         if(selected == -1)
@@ -292,13 +459,279 @@ static inline VF2State *vf2state_create(void *memory, const Molecule *restrict q
     vf2state->isotopeMode = isotopeMode;
     vf2state->radicalMode = radicalMode;
     vf2state->stereoMode = stereoMode;
+
+    if(chargeMode == CHARGE_DEFAULT_AS_ANY && isotopeMode == ISOTOPE_IGNORE && radicalMode == RADICAL_IGNORE)
+        vf2state->matchCore = searchMode == SEARCH_EXACT ? vf2state_match_core_exact : vf2state_match_core_substructure;
+    else
+        vf2state->matchCore = vf2state_match_core_generic;
+
     vf2state->query = query;
     vf2state->queryAtomCount = queryAtomCount;
     vf2state->coreLength = 0;
-    vf2state->queryCore = queryCore;
+    vf2state->queryCore = NULL;
     vf2state->queryOrder = queryOrder;
     vf2state->queryParents = queryParents;
-    vf2state->undos = undos;
+    vf2state->queryWeights = weights;
+    vf2state->queryWeightCount = weightCount;
+    vf2state->undos = NULL;
+    vf2state->queryDomains = NULL;
+    vf2state->queryDomainReady = NULL;
+    vf2state->stereoCheckOffsets = NULL;
+    vf2state->stereoChecks = NULL;
+    vf2state->querySGroupAtoms = NULL;
+    vf2state->querySGroupBonds = NULL;
+
+
+    if(query->sgroups != NULL && query->sgroupCount <= VF2_SGROUP_BITS)
+    {
+        for(int i = 0; i < queryAtomCount; i++)
+        {
+            querySGroupAtoms[i] = 0;
+            querySGroupBonds[i] = 0;
+        }
+
+        for(int g = 0; g < query->sgroupCount; g++)
+        {
+            const SGroup *restrict group = query->sgroups + g;
+
+            for(int i = 0; i < group->atomCount; i++)
+                if(group->atoms[i] < queryAtomCount)
+                    querySGroupAtoms[group->atoms[i]] |= (uint64_t) 1 << g;
+
+            for(int i = 0; i < group->bondCount; i++)
+            {
+                if(group->bonds[i][0] < queryAtomCount && group->bonds[i][1] < queryAtomCount)
+                {
+                    querySGroupBonds[group->bonds[i][0]] |= (uint64_t) 1 << g;
+                    querySGroupBonds[group->bonds[i][1]] |= (uint64_t) 1 << g;
+                }
+            }
+        }
+
+        vf2state->querySGroupAtoms = querySGroupAtoms;
+        vf2state->querySGroupBonds = querySGroupBonds;
+    }
+
+
+    /*
+    In the strict stereo mode, each stereo constraint of the query is scheduled at the depth of the
+    search where the last query atom it refers to is mapped, so that the constraint can prune the
+    search tree instead of being checked only for complete mappings. Extended stereo centres and
+    bonds are rare and refer to whole cumulene chains, so they are checked at the last depth.
+    */
+
+    if(stereoMode == STEREO_STRICT && query->atomStereo != NULL && queryAtomCount > 0)
+    {
+        int queryPositions[queryAtomCount];
+        int checkPositions[queryAtomCount + query->bondCount];
+        int checkCount = 0;
+
+        for(int i = 0; i < queryAtomCount; i++)
+            queryPositions[queryOrder[i]] = i;
+
+        for(int i = 0; i <= queryAtomCount; i++)
+            stereoCheckOffsets[i] = 0;
+
+        for(AtomIdx i = 0; i < queryAtomCount; i++)
+        {
+            uint8_t stereo = molecule_get_atom_stereo(query, i);
+
+            if(stereo == TETRAHEDRAL_STEREO_NONE || (stereo == TETRAHEDRAL_STEREO_UNDEFINED && searchMode != SEARCH_EXACT))
+                continue;
+
+            int position = queryPositions[i];
+
+            if(stereo != TETRAHEDRAL_STEREO_UNDEFINED)
+            {
+                if(is_extended_tetrahedral_centre(query, i))
+                {
+                    position = queryAtomCount - 1;
+                }
+                else
+                {
+                    AtomIdx *bondedAtomList = molecule_get_bonded_atom_list(query, i);
+                    MolSize listSize = molecule_get_bonded_atom_list_size(query, i);
+
+                    for(int j = 0; j < listSize; j++)
+                        if(queryPositions[bondedAtomList[j]] > position)
+                            position = queryPositions[bondedAtomList[j]];
+                }
+            }
+
+            stereoChecks[checkCount] = i;
+            checkPositions[checkCount++] = position;
+            stereoCheckOffsets[position + 1]++;
+        }
+
+        for(BondIdx i = 0; i < query->bondCount; i++)
+        {
+            uint8_t stereo = molecule_get_bond_stereo(query, i);
+
+            if(stereo == BOND_STEREO_NONE || (stereo == BOND_STEREO_UNDEFINED && searchMode != SEARCH_EXACT))
+                continue;
+
+            AtomIdx *bondAtoms = molecule_bond_atoms(query, i);
+            int position = queryPositions[bondAtoms[0]];
+
+            if(queryPositions[bondAtoms[1]] > position)
+                position = queryPositions[bondAtoms[1]];
+
+            if(stereo != BOND_STEREO_UNDEFINED)
+            {
+                if(is_extended_cis_trans(query, i))
+                {
+                    position = queryAtomCount - 1;
+                }
+                else
+                {
+                    for(int a = 0; a < 2; a++)
+                    {
+                        AtomIdx *bondedAtomList = molecule_get_bonded_atom_list(query, bondAtoms[a]);
+                        MolSize listSize = molecule_get_bonded_atom_list_size(query, bondAtoms[a]);
+
+                        for(int j = 0; j < listSize; j++)
+                            if(queryPositions[bondedAtomList[j]] > position)
+                                position = queryPositions[bondedAtomList[j]];
+                    }
+                }
+            }
+
+            stereoChecks[checkCount] = -1 - i;
+            checkPositions[checkCount++] = position;
+            stereoCheckOffsets[position + 1]++;
+        }
+
+        if(checkCount > 0)
+        {
+            int scheduled[checkCount];
+
+            for(int i = 0; i < checkCount; i++)
+                scheduled[i] = stereoChecks[i];
+
+            for(int i = 0; i < queryAtomCount; i++)
+                stereoCheckOffsets[i + 1] += stereoCheckOffsets[i];
+
+            int next[queryAtomCount];
+
+            for(int i = 0; i < queryAtomCount; i++)
+                next[i] = stereoCheckOffsets[i];
+
+            for(int i = 0; i < checkCount; i++)
+                stereoChecks[next[checkPositions[i]]++] = scheduled[i];
+
+            vf2state->stereoCheckOffsets = stereoCheckOffsets;
+            vf2state->stereoChecks = stereoChecks;
+        }
+    }
+
+
+    int queryFixedXAtomCount = 0;
+    int queryChargedAtomCount = 0;
+    int queryIsotopeAtomCount = 0;
+    int queryElementCount = 0;
+
+    for(AtomIdx i = 0; i < query->xAtomCount; i++)
+    {
+        int8_t number = molecule_get_atom_number(query, i);
+
+        if(number != R_ATOM_NUMBER)
+            queryFixedXAtomCount++;
+
+        int e = 0;
+
+        while(e < queryElementCount && queryElementNumbers[e] != number)
+            e++;
+
+        if(e == queryElementCount)
+        {
+            queryElementNumbers[queryElementCount] = number;
+            queryElementCounts[queryElementCount++] = 0;
+        }
+
+        queryElementCounts[e]++;
+    }
+
+    for(AtomIdx i = 0; i < query->heavyAtomCount; i++)
+    {
+        if(molecule_get_atom_number(query, i) < 0)
+            continue;
+
+        if(query->atomCharges != NULL && molecule_get_formal_charge(query, i) != 0)
+            queryChargedAtomCount++;
+
+        if(query->atomMasses != NULL && molecule_get_atom_mass(query, i) != 0)
+            queryIsotopeAtomCount++;
+    }
+
+    /*
+    A bond between two ordinary heavy atoms can only be mapped to a target bond of the same plain type
+    between atoms of the same elements, and an embedding cannot have more independent rings than the
+    target, which gives the pattern screens cheap necessary conditions.
+    */
+    int queryRingCount = 0;
+    int queryXBondCount = 0;
+    uint64_t queryBondFeatures = 0;
+    int components[queryAtomCount];
+
+    for(int i = 0; i < queryAtomCount; i++)
+        components[i] = i;
+
+    for(int t = 0; t < VF2_SCREEN_BOND_TYPES; t++)
+        vf2state->queryBondTypeCounts[t] = 0;
+
+    for(BondIdx b = 0; b < query->bondCount; b++)
+    {
+        AtomIdx *restrict atoms = molecule_bond_atoms(query, b);
+        uint8_t type = molecule_get_bond_type(query, b);
+
+        if(!join_components(components, atoms[0], atoms[1]))
+            queryRingCount++;
+
+        /* the binary format keeps a bond in the x-bond block unless it ends in a hydrogen with a single bond */
+        if((atoms[0] < query->heavyAtomCount || molecule_get_bonded_atom_list_size(query, atoms[0]) > 1) &&
+                (atoms[1] < query->heavyAtomCount || molecule_get_bonded_atom_list_size(query, atoms[1]) > 1))
+            queryXBondCount++;
+
+        int8_t number0 = molecule_get_atom_number(query, atoms[0]);
+        int8_t number1 = molecule_get_atom_number(query, atoms[1]);
+
+        if(type < VF2_SCREEN_BOND_TYPES && number0 > H_ATOM_NUMBER && number1 > H_ATOM_NUMBER)
+        {
+            vf2state->queryBondTypeCounts[type]++;
+            queryBondFeatures |= bond_feature(number0, number1, type);
+        }
+    }
+
+    vf2state->queryRingCount = queryRingCount;
+    vf2state->queryBondFeatures = queryBondFeatures;
+    vf2state->queryCAtomCount = query->heavyAtomCount - query->xAtomCount;
+    vf2state->queryXBondCount = queryXBondCount;
+    vf2state->queryFixedXAtomCount = queryFixedXAtomCount;
+    vf2state->queryChargedAtomCount = queryChargedAtomCount;
+    vf2state->queryIsotopeAtomCount = queryIsotopeAtomCount;
+    vf2state->queryElementCount = queryElementCount;
+    vf2state->queryElementNumbers = queryElementNumbers;
+    vf2state->queryElementCounts = queryElementCounts;
+
+    return vf2state;
+}
+
+
+/*
+The state created by vf2state_create holds only data derived from the query, so it can be shared.
+A search runs on a fork that adds the mutable parts of the state.
+*/
+static inline VF2State *vf2state_fork(void *memory, const VF2State *restrict template)
+{
+    VF2State *restrict vf2state = (VF2State *) alloc_memory(&memory, sizeof(VF2State));
+
+    int queryAtomCount = template->queryAtomCount;
+
+    *vf2state = *template;
+    vf2state->queryCore = (AtomIdx *) alloc_memory(&memory, queryAtomCount * sizeof(AtomIdx));
+    vf2state->undos = (VF2Undo *) alloc_memory(&memory, queryAtomCount * sizeof(VF2Undo));
+    vf2state->queryDomains = (VF2Mask *) alloc_memory(&memory, queryAtomCount * sizeof(VF2Mask));
+    vf2state->queryDomainReady = (bool *) alloc_memory(&memory, queryAtomCount * sizeof(bool));
 
     return vf2state;
 }
@@ -317,11 +750,34 @@ static inline bool vf2state_next_query(VF2State *restrict vf2state)
 }
 
 
-static inline bool vf2state_next_target(VF2State *restrict vf2state)
+static pg_attribute_always_inline bool vf2state_next_target(VF2State *restrict vf2state, SearchMode searchMode)
 {
     AtomIdx query_parent = vf2state->queryParents[vf2state->queryIdx];
 
-    if(likely(query_parent >= 0))
+    if(likely(vf2state->bitParallel))
+    {
+        VF2Mask candidates = vf2state->queryDomains[vf2state->queryIdx];
+
+        for(int w = 0; w < VF2_MASK_BITS / 64; w++)
+            candidates.words[w] &= ~vf2state->targetMapped.words[w];
+
+        if(likely(query_parent >= 0))
+        {
+            const VF2Mask *restrict adjacency = &vf2state->targetAdjacency[vf2state->queryCore[query_parent]];
+
+            for(int w = 0; w < VF2_MASK_BITS / 64; w++)
+                candidates.words[w] &= adjacency->words[w];
+        }
+
+        int targetIdx = vf2mask_next(&candidates, vf2state->targetIdx + 1);
+
+        if(targetIdx < 0)
+            return false;
+
+        vf2state->targetIdx = targetIdx;
+        return true;
+    }
+    else if(likely(query_parent >= 0))
     {
         AtomIdx target_parent = vf2state->queryCore[query_parent];
         AtomIdx *restrict targetBondedAtomList = molecule_get_bonded_atom_list(vf2state->target, target_parent);
@@ -340,10 +796,31 @@ static inline bool vf2state_next_target(VF2State *restrict vf2state)
     }
     else
     {
-        for(vf2state->targetIdx++; vf2state->targetIdx < vf2state->targetAtomCount; vf2state->targetIdx++)
+        int8_t queryAtomNumber = molecule_get_atom_number(vf2state->query, vf2state->queryIdx);
+
+        if(searchMode == SEARCH_EXACT || queryAtomNumber > 0 || queryAtomNumber == UNKNOWN_ATOM_NUMBER)
         {
-            if(!is_core_defined(vf2state->targetCore[vf2state->targetIdx]))
-                return true;
+            int targetAtomListSize;
+            AtomIdx *restrict targetAtomList = molecule_get_atoms_by_number(vf2state->target, queryAtomNumber, &targetAtomListSize);
+
+            for(vf2state->targetSelector++; vf2state->targetSelector < targetAtomListSize; vf2state->targetSelector++)
+            {
+                AtomIdx targetIdx = targetAtomList[vf2state->targetSelector];
+
+                if(!is_core_defined(vf2state->targetCore[targetIdx]))
+                {
+                    vf2state->targetIdx = targetIdx;
+                    return true;
+                }
+            }
+        }
+        else
+        {
+            for(vf2state->targetIdx++; vf2state->targetIdx < vf2state->targetAtomCount; vf2state->targetIdx++)
+            {
+                if(!is_core_defined(vf2state->targetCore[vf2state->targetIdx]))
+                    return true;
+            }
         }
     }
 
@@ -351,7 +828,8 @@ static inline bool vf2state_next_target(VF2State *restrict vf2state)
 }
 
 
-static inline bool vf2state_atom_matches(const VF2State *restrict vf2state, AtomIdx queryAtom, AtomIdx targetAtom)
+static pg_attribute_always_inline bool vf2state_atom_matches(const VF2State *restrict vf2state, AtomIdx queryAtom,
+        AtomIdx targetAtom, SearchMode searchMode)
 {
     int8_t queryAtomNumber = molecule_get_atom_number(vf2state->query, queryAtom);
     int8_t targetAtomNumber = molecule_get_atom_number(vf2state->target, targetAtom);
@@ -369,7 +847,7 @@ static inline bool vf2state_atom_matches(const VF2State *restrict vf2state, Atom
     }
 
 
-    if(vf2state->searchMode == SEARCH_EXACT)
+    if(searchMode == SEARCH_EXACT)
         return queryAtomNumber == targetAtomNumber;
     else if(queryAtomNumber == UNKNOWN_ATOM_NUMBER || targetAtomNumber == UNKNOWN_ATOM_NUMBER)
         return false;
@@ -388,18 +866,16 @@ static inline bool vf2state_atom_matches(const VF2State *restrict vf2state, Atom
 }
 
 
-static inline bool vf2state_bond_matches(const VF2State *restrict vf2state, AtomIdx qIdx1, AtomIdx qIdx2, AtomIdx tIdx1, AtomIdx tIdx2)
+static pg_attribute_always_inline bool vf2state_bond_matches(const VF2State *restrict vf2state, BondIdx queryBond,
+        BondIdx targetbond, SearchMode searchMode)
 {
-    BondIdx queryBond = molecule_get_bond(vf2state->query, qIdx1, qIdx2);
-    BondIdx targetbond = molecule_get_bond(vf2state->target, tIdx1, tIdx2);
-
     if(likely(queryBond < 0 || targetbond < 0))
         return false;
 
     uint8_t queryBondType = molecule_get_bond_type(vf2state->query, queryBond);
     uint8_t targetbondType = molecule_get_bond_type(vf2state->target, targetbond);
 
-    if(vf2state->searchMode == SEARCH_EXACT)
+    if(searchMode == SEARCH_EXACT)
         return queryBondType == targetbondType;
     else if(queryBondType == targetbondType || queryBondType == BOND_ANY)
         return true;
@@ -414,60 +890,113 @@ static inline bool vf2state_bond_matches(const VF2State *restrict vf2state, Atom
 }
 
 
-static inline bool vf2state_is_feasible_pair(const VF2State *restrict vf2state)
+static pg_attribute_always_inline bool vf2state_is_feasible_atom(const VF2State *restrict vf2state, AtomIdx queryAtom,
+        AtomIdx targetAtom, SearchMode searchMode, ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode)
 {
-    if(likely(!vf2state_atom_matches(vf2state, vf2state->queryIdx, vf2state->targetIdx)))
+    if(likely(!vf2state_atom_matches(vf2state, queryAtom, targetAtom, searchMode)))
         return false;
 
 
-    if(vf2state->chargeMode != CHARGE_IGNORE)
+    if(chargeMode != CHARGE_IGNORE)
     {
-        int8_t queryCharge = molecule_get_formal_charge(vf2state->query, vf2state->queryIdx);
-        int8_t targetCharge = molecule_get_formal_charge(vf2state->target, vf2state->targetIdx);
+        int8_t queryCharge = molecule_get_formal_charge(vf2state->query, queryAtom);
+        int8_t targetCharge = molecule_get_formal_charge(vf2state->target, targetAtom);
 
-        if(queryCharge != targetCharge && (queryCharge != 0 || vf2state->chargeMode == CHARGE_DEFAULT_AS_UNCHARGED))
+        if(queryCharge != targetCharge && (queryCharge != 0 || chargeMode == CHARGE_DEFAULT_AS_UNCHARGED))
             return false;
     }
 
 
-    if(vf2state->isotopeMode != ISOTOPE_IGNORE)
+    if(isotopeMode != ISOTOPE_IGNORE)
     {
-        int8_t queryMass = molecule_get_atom_mass(vf2state->query, vf2state->queryIdx);
-        int8_t targetMass = molecule_get_atom_mass(vf2state->target, vf2state->targetIdx);
+        int8_t queryMass = molecule_get_atom_mass(vf2state->query, queryAtom);
+        int8_t targetMass = molecule_get_atom_mass(vf2state->target, targetAtom);
 
-        if(queryMass != targetMass && (queryMass != 0 || vf2state->isotopeMode == ISOTOPE_DEFAULT_AS_STANDARD))
+        if(queryMass != targetMass && (queryMass != 0 || isotopeMode == ISOTOPE_DEFAULT_AS_STANDARD))
             return false;
     }
 
 
-    if(vf2state->radicalMode != RADICAL_IGNORE)
+    if(radicalMode != RADICAL_IGNORE)
     {
-        int8_t queryType = molecule_get_atom_radical_type(vf2state->query, vf2state->queryIdx);
-        int8_t targetType = molecule_get_atom_radical_type(vf2state->target, vf2state->targetIdx);
+        int8_t queryType = molecule_get_atom_radical_type(vf2state->query, queryAtom);
+        int8_t targetType = molecule_get_atom_radical_type(vf2state->target, targetAtom);
 
-        if(queryType != targetType && (queryType != 0 || vf2state->radicalMode == RADICAL_DEFAULT_AS_STANDARD))
+        if(queryType != targetType && (queryType != 0 || radicalMode == RADICAL_DEFAULT_AS_STANDARD))
             return false;
     }
 
 
-    if(likely(vf2state->searchMode == SEARCH_EXACT))
+    if(likely(searchMode == SEARCH_EXACT))
     {
-        if(unlikely(molecule_get_hydrogen_count(vf2state->query, vf2state->queryIdx) !=
-                molecule_get_hydrogen_count(vf2state->target, vf2state->targetIdx)))
+        if(unlikely(molecule_get_hydrogen_count(vf2state->query, queryAtom) !=
+                molecule_get_hydrogen_count(vf2state->target, targetAtom)))
             return false;
     }
     else
     {
-        if(unlikely(molecule_get_hydrogen_count(vf2state->query, vf2state->queryIdx) >
-                molecule_get_hydrogen_count(vf2state->target, vf2state->targetIdx)))
+        if(unlikely(molecule_get_hydrogen_count(vf2state->query, queryAtom) >
+                molecule_get_hydrogen_count(vf2state->target, targetAtom)))
             return false;
     }
 
+    return true;
+}
+
+
+static pg_attribute_always_inline bool vf2state_compute_domain(VF2State *restrict vf2state, SearchMode searchMode,
+        ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode)
+{
+    AtomIdx queryIdx = vf2state->queryIdx;
+    MolSize queryDegree = molecule_get_bonded_atom_list_size(vf2state->query, queryIdx);
+    int8_t queryAtomNumber = molecule_get_atom_number(vf2state->query, queryIdx);
+
+    VF2Mask domain = { { 0 } };
+
+    if(searchMode == SEARCH_EXACT || queryAtomNumber > 0 || queryAtomNumber == UNKNOWN_ATOM_NUMBER)
+    {
+        int targetAtomListSize;
+        AtomIdx *restrict targetAtomList = molecule_get_atoms_by_number(vf2state->target, queryAtomNumber, &targetAtomListSize);
+
+        for(int i = 0; i < targetAtomListSize; i++)
+        {
+            AtomIdx targetIdx = targetAtomList[i];
+
+            if(molecule_get_bonded_atom_list_size(vf2state->target, targetIdx) >= queryDegree &&
+                    vf2state_is_feasible_atom(vf2state, queryIdx, targetIdx, searchMode, chargeMode, isotopeMode, radicalMode))
+                vf2mask_set(&domain, targetIdx);
+        }
+    }
+    else
+    {
+        for(AtomIdx targetIdx = 0; targetIdx < vf2state->targetAtomCount; targetIdx++)
+        {
+            if(molecule_get_bonded_atom_list_size(vf2state->target, targetIdx) >= queryDegree &&
+                    vf2state_is_feasible_atom(vf2state, queryIdx, targetIdx, searchMode, chargeMode, isotopeMode, radicalMode))
+                vf2mask_set(&domain, targetIdx);
+        }
+    }
+
+    vf2state->queryDomains[queryIdx] = domain;
+    vf2state->queryDomainReady[queryIdx] = true;
+
+    for(int w = 0; w < VF2_MASK_BITS / 64; w++)
+        if(domain.words[w] != 0)
+            return true;
+
+    return false;
+}
 
+
+static pg_attribute_always_inline bool vf2state_is_feasible_pair_masked(const VF2State *restrict vf2state, SearchMode searchMode)
+{
+    const VF2Mask *restrict adjacency = &vf2state->targetAdjacency[vf2state->targetIdx];
+
+    int mappedQuery = 0;
     int newQuery = 0;
-    int newTarget = 0;
 
     AtomIdx *restrict queryBondedAtomList = molecule_get_bonded_atom_list(vf2state->query, vf2state->queryIdx);
+    BondIdx *restrict queryBondedBondList = molecule_get_bonded_bond_list(vf2state->query, vf2state->queryIdx);
     MolSize queryBondedAtomListSize = molecule_get_bonded_atom_list_size(vf2state->query, vf2state->queryIdx);
 
     for(int i = 0; i < queryBondedAtomListSize; i++)
@@ -478,8 +1007,15 @@ static inline bool vf2state_is_feasible_pair(const VF2State *restrict vf2state)
         {
             AtomIdx other2 = vf2state->queryCore[other1];
 
-            if(!vf2state_bond_matches(vf2state, vf2state->queryIdx, other1, vf2state->targetIdx, other2))
+            if(!vf2mask_test(adjacency, other2))
                 return false;
+
+            BondIdx targetBond = molecule_get_bond(vf2state->target, vf2state->targetIdx, other2);
+
+            if(!vf2state_bond_matches(vf2state, queryBondedBondList[i], targetBond, searchMode))
+                return false;
+
+            mappedQuery++;
         }
         else
         {
@@ -488,21 +1024,75 @@ static inline bool vf2state_is_feasible_pair(const VF2State *restrict vf2state)
     }
 
 
-    AtomIdx *restrict targetBondedAtomList = molecule_get_bonded_atom_list(vf2state->target, vf2state->targetIdx);
-    MolSize targetBondedAtomListSize = molecule_get_bonded_atom_list_size(vf2state->target, vf2state->targetIdx);
+    int mappedTarget = 0;
+    int newTarget = 0;
 
-    for(int i = 0; i < targetBondedAtomListSize; i++)
+    for(int w = 0; w < VF2_MASK_BITS / 64; w++)
     {
-        AtomIdx other2 = targetBondedAtomList[i];
-
-        if(is_core_defined(vf2state->targetCore[other2]))
-        {
-            if(unlikely(vf2state->searchMode == SEARCH_EXACT))
-            {
-                AtomIdx other1 = vf2state->targetCore[other2];
+        mappedTarget += __builtin_popcountll(adjacency->words[w] & vf2state->targetMapped.words[w]);
+        newTarget += __builtin_popcountll(adjacency->words[w] & ~vf2state->targetMapped.words[w]);
+    }
 
-                if(!vf2state_bond_matches(vf2state, vf2state->queryIdx, other1, vf2state->targetIdx, other2))
-                    return false;
+    if(unlikely(searchMode == SEARCH_EXACT))
+        return mappedQuery == mappedTarget && newQuery == newTarget;
+    else
+        return newQuery <= newTarget;
+}
+
+
+static pg_attribute_always_inline bool vf2state_is_feasible_pair(const VF2State *restrict vf2state, SearchMode searchMode,
+        ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode)
+{
+    if(likely(vf2state->bitParallel))
+        return vf2state_is_feasible_pair_masked(vf2state, searchMode);
+
+    if(!vf2state_is_feasible_atom(vf2state, vf2state->queryIdx, vf2state->targetIdx, searchMode, chargeMode, isotopeMode, radicalMode))
+        return false;
+
+
+    int newQuery = 0;
+    int newTarget = 0;
+
+    AtomIdx *restrict queryBondedAtomList = molecule_get_bonded_atom_list(vf2state->query, vf2state->queryIdx);
+    BondIdx *restrict queryBondedBondList = molecule_get_bonded_bond_list(vf2state->query, vf2state->queryIdx);
+    MolSize queryBondedAtomListSize = molecule_get_bonded_atom_list_size(vf2state->query, vf2state->queryIdx);
+
+    for(int i = 0; i < queryBondedAtomListSize; i++)
+    {
+        AtomIdx other1 = queryBondedAtomList[i];
+
+        if(is_core_defined(vf2state->queryCore[other1]))
+        {
+            AtomIdx other2 = vf2state->queryCore[other1];
+            BondIdx targetBond = molecule_get_bond(vf2state->target, vf2state->targetIdx, other2);
+
+            if(!vf2state_bond_matches(vf2state, queryBondedBondList[i], targetBond, searchMode))
+                return false;
+        }
+        else
+        {
+            newQuery++;
+        }
+    }
+
+
+    AtomIdx *restrict targetBondedAtomList = molecule_get_bonded_atom_list(vf2state->target, vf2state->targetIdx);
+    BondIdx *restrict targetBondedBondList = molecule_get_bonded_bond_list(vf2state->target, vf2state->targetIdx);
+    MolSize targetBondedAtomListSize = molecule_get_bonded_atom_list_size(vf2state->target, vf2state->targetIdx);
+
+    for(int i = 0; i < targetBondedAtomListSize; i++)
+    {
+        AtomIdx other2 = targetBondedAtomList[i];
+
+        if(is_core_defined(vf2state->targetCore[other2]))
+        {
+            if(unlikely(searchMode == SEARCH_EXACT))
+            {
+                AtomIdx other1 = vf2state->targetCore[other2];
+                BondIdx queryBond = molecule_get_bond(vf2state->query, vf2state->queryIdx, other1);
+
+                if(!vf2state_bond_matches(vf2state, queryBond, targetBondedBondList[i], searchMode))
+                    return false;
             }
         }
         else
@@ -511,7 +1101,7 @@ static inline bool vf2state_is_feasible_pair(const VF2State *restrict vf2state)
         }
     }
 
-    if(unlikely(vf2state->searchMode == SEARCH_EXACT))
+    if(unlikely(searchMode == SEARCH_EXACT))
         return newQuery == newTarget;
     else
         return newQuery <= newTarget;
@@ -527,6 +1117,9 @@ static inline void vf2state_undo_add_pair(VF2State *restrict vf2state)
     vf2state->queryCore[vf2state->queryIdx] = UNDEFINED_CORE;
     vf2state->targetCore[undo->targetIdx] = UNDEFINED_CORE;
 
+    if(vf2state->bitParallel)
+        vf2mask_clear(&vf2state->targetMapped, undo->targetIdx);
+
     vf2state->targetSelector = undo->targetSelector;
     vf2state->targetIdx = undo->targetIdx;
 }
@@ -540,311 +1133,338 @@ static inline void vf2state_add_pair(VF2State *restrict vf2state)
     vf2state->queryCore[vf2state->queryIdx] = vf2state->targetIdx;
     vf2state->targetCore[vf2state->targetIdx] = vf2state->queryIdx;
 
+    if(vf2state->bitParallel)
+        vf2mask_set(&vf2state->targetMapped, vf2state->targetIdx);
+
     undo->targetSelector = vf2state->targetSelector;
     undo->targetIdx = vf2state->targetIdx;
 }
 
 
-static inline bool vf2state_is_stereo_valid(const VF2State *restrict vf2state)
+static inline bool vf2state_is_atom_stereo_valid(const VF2State *restrict vf2state, AtomIdx queryAtomIdx)
 {
     const Molecule *restrict query = vf2state->query;
     const Molecule *restrict target = vf2state->target;
 
-    int queryAtomCount = query->atomCount;
-    int queryBondCount = query->bondCount;
+    uint8_t queryStereo = molecule_get_atom_stereo(query, queryAtomIdx);
 
+    AtomIdx targetAtomIdx = vf2state->queryCore[queryAtomIdx];
+    uint8_t targetStereo = molecule_get_atom_stereo(target, targetAtomIdx);
 
-    for(AtomIdx queryAtomIdx = 0; queryAtomIdx < queryAtomCount; queryAtomIdx++)
+    if(queryStereo == TETRAHEDRAL_STEREO_UNDEFINED)
     {
-        uint8_t queryStereo = molecule_get_atom_stereo(query, queryAtomIdx);
-
-        AtomIdx targetAtomIdx = vf2state->queryCore[queryAtomIdx];
-        uint8_t targetStereo = molecule_get_atom_stereo(target, targetAtomIdx);
+        if(vf2state->searchMode == SEARCH_EXACT && targetStereo != TETRAHEDRAL_STEREO_UNDEFINED)
+            return false;
+    }
+    else if(queryStereo != TETRAHEDRAL_STEREO_NONE)
+    {
+        if(vf2state->searchMode == SEARCH_EXACT && targetStereo == TETRAHEDRAL_STEREO_UNDEFINED)
+            return false;
 
-        if(queryStereo == TETRAHEDRAL_STEREO_UNDEFINED)
-        {
-            if(vf2state->searchMode == SEARCH_EXACT && targetStereo != TETRAHEDRAL_STEREO_UNDEFINED)
-                return false;
-        }
-        else if(queryStereo != TETRAHEDRAL_STEREO_NONE)
-        {
-            if(vf2state->searchMode == SEARCH_EXACT && targetStereo == TETRAHEDRAL_STEREO_UNDEFINED)
-                return false;
+        if(targetStereo == TETRAHEDRAL_STEREO_NONE || targetStereo == TETRAHEDRAL_STEREO_UNDEFINED)
+            return true;
 
-            if(targetStereo == TETRAHEDRAL_STEREO_NONE || targetStereo == TETRAHEDRAL_STEREO_UNDEFINED)
-                continue;
 
+        if(is_extended_tetrahedral_centre(query, queryAtomIdx))
+        {
+            AtomIdx queryTerminalAtoms[2];
+            AtomIdx queryPreTerminalAtoms[2];
+            AtomIdx queryAtoms[4];
+            MolSize listSize = 0;
 
-            if(is_extended_tetrahedral_centre(query, queryAtomIdx))
+            for(int i = 0; i < 2; i++)
             {
-                AtomIdx queryTerminalAtoms[2];
-                AtomIdx queryPreTerminalAtoms[2];
-                AtomIdx queryAtoms[4];
-                MolSize listSize = 0;
+                AtomIdx atom = queryAtomIdx;
+                AtomIdx bonded = molecule_get_bonded_atom_list(query, queryAtomIdx)[i];
 
-                for(int i = 0; i < 2; i++)
+                while(true)
                 {
-                    AtomIdx atom = queryAtomIdx;
-                    AtomIdx bonded = molecule_get_bonded_atom_list(query, queryAtomIdx)[i];
+                    MolSize newListSize = molecule_get_bonded_atom_list_size(query, bonded);
 
-                    while(true)
+                    if(newListSize == 3)
                     {
-                        MolSize newListSize = molecule_get_bonded_atom_list_size(query, bonded);
+                        queryTerminalAtoms[i] = bonded;
+                        queryPreTerminalAtoms[i] = atom;
 
-                        if(newListSize == 3)
+                        for(int j = 0; j < 3; j++)
                         {
-                            queryTerminalAtoms[i] = bonded;
-                            queryPreTerminalAtoms[i] = atom;
+                            AtomIdx o = molecule_get_bonded_atom_list(query, bonded)[j];
 
-                            for(int j = 0; j < 3; j++)
-                            {
-                                AtomIdx o = molecule_get_bonded_atom_list(query, bonded)[j];
+                            if(o == atom)
+                                continue;
 
-                                if(o == atom)
-                                    continue;
+                            queryAtoms[listSize++] = o;
+                        }
 
-                                queryAtoms[listSize++] = o;
-                            }
+                        break;
+                    }
+                    else if(newListSize == 2)
+                    {
+                        AtomIdx next = molecule_get_opposite_atom(query, bonded, atom);
 
-                            break;
-                        }
-                        else if(newListSize == 2)
-                        {
-                            AtomIdx next = molecule_get_opposite_atom(query, bonded, atom);
-
-                            if(molecule_get_bond_type(query, molecule_get_bond(query, bonded, next)) != BOND_DOUBLE)
-                            {
-                                queryTerminalAtoms[i] = bonded;
-                                queryPreTerminalAtoms[i] = atom;
-                                queryAtoms[listSize++] = next;
-                                queryAtoms[listSize++] = MAX_ATOM_IDX;
-                                break;
-                            }
-
-                            atom = bonded;
-                            bonded = next;
-                        }
-                        else
+                        if(molecule_get_bond_type(query, molecule_get_bond(query, bonded, next)) != BOND_DOUBLE)
                         {
+                            queryTerminalAtoms[i] = bonded;
+                            queryPreTerminalAtoms[i] = atom;
+                            queryAtoms[listSize++] = next;
+                            queryAtoms[listSize++] = MAX_ATOM_IDX;
                             break;
                         }
+
+                        atom = bonded;
+                        bonded = next;
+                    }
+                    else
+                    {
+                        break;
                     }
                 }
+            }
 
-                if(listSize < 4)
-                    continue;
+            if(listSize < 4)
+                return true;
 
-                sort_bond_atoms(queryAtoms);
+            sort_bond_atoms(queryAtoms);
 
 
-                AtomIdx targetTerminalAtom0 = vf2state->queryCore[queryTerminalAtoms[0]];
-                AtomIdx targetTerminalAtom1 = vf2state->queryCore[queryTerminalAtoms[1]];
-                AtomIdx targetPreTerminalAtom0 = vf2state->queryCore[queryPreTerminalAtoms[0]];
-                AtomIdx targetPreTerminalAtom1 = vf2state->queryCore[queryPreTerminalAtoms[1]];
+            AtomIdx targetTerminalAtom0 = vf2state->queryCore[queryTerminalAtoms[0]];
+            AtomIdx targetTerminalAtom1 = vf2state->queryCore[queryTerminalAtoms[1]];
+            AtomIdx targetPreTerminalAtom0 = vf2state->queryCore[queryPreTerminalAtoms[0]];
+            AtomIdx targetPreTerminalAtom1 = vf2state->queryCore[queryPreTerminalAtoms[1]];
 
-                AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
+            AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
 
-                for(int i = 0; i < 4; i++)
-                    if(queryAtoms[i] != MAX_ATOM_IDX)
-                        targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
+            for(int i = 0; i < 4; i++)
+                if(queryAtoms[i] != MAX_ATOM_IDX)
+                    targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
 
-                if(queryAtoms[1] == MAX_ATOM_IDX)
-                    targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom0, targetPreTerminalAtom0, targetAtoms[0]);
+            if(queryAtoms[1] == MAX_ATOM_IDX)
+                targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom0, targetPreTerminalAtom0, targetAtoms[0]);
 
-                if(queryAtoms[3] == MAX_ATOM_IDX)
-                    targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom1, targetPreTerminalAtom1, targetAtoms[2]);
+            if(queryAtoms[3] == MAX_ATOM_IDX)
+                targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom1, targetPreTerminalAtom1, targetAtoms[2]);
 
-                if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
-                    return false;
-            }
-            else
-            {
-                AtomIdx *bondedAtomList = molecule_get_bonded_atom_list(query, queryAtomIdx);
-                MolSize listSize = molecule_get_bonded_atom_list_size(query, queryAtomIdx);
+            if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
+                return false;
+        }
+        else
+        {
+            AtomIdx *bondedAtomList = molecule_get_bonded_atom_list(query, queryAtomIdx);
+            MolSize listSize = molecule_get_bonded_atom_list_size(query, queryAtomIdx);
 
-                if(listSize < 3)
-                    continue;
+            if(listSize < 3)
+                return true;
 
-                AtomIdx queryAtoms[4];
+            AtomIdx queryAtoms[4];
 
-                for(int i = 0; i < listSize; i++)
-                    queryAtoms[i] = bondedAtomList[i];
+            for(int i = 0; i < listSize; i++)
+                queryAtoms[i] = bondedAtomList[i];
 
-                if(listSize == 3)
-                    queryAtoms[3] = MAX_ATOM_IDX;
+            if(listSize == 3)
+                queryAtoms[3] = MAX_ATOM_IDX;
 
-                sort_stereo_atoms(queryAtoms);
+            sort_stereo_atoms(queryAtoms);
 
 
-                AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
+            AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
 
-                for(int i = 0; i < listSize; i++)
-                    targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
+            for(int i = 0; i < listSize; i++)
+                targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
 
-                if(listSize == 3)
-                    targetAtoms[3] = molecule_get_last_chiral_ligand(target, vf2state->queryCore[queryAtomIdx], targetAtoms);
+            if(listSize == 3)
+                targetAtoms[3] = molecule_get_last_chiral_ligand(target, vf2state->queryCore[queryAtomIdx], targetAtoms);
 
-                if(normalize_atom_stereo(targetAtoms, targetStereo) != queryStereo)
-                    return false;
-            }
+            if(normalize_atom_stereo(targetAtoms, targetStereo) != queryStereo)
+                return false;
         }
     }
 
+    return true;
+}
 
-    for(BondIdx queryBondIdx = 0; queryBondIdx < queryBondCount; queryBondIdx++)
-    {
-        uint8_t queryStereo = molecule_get_bond_stereo(query, queryBondIdx);
 
-        AtomIdx *queryBondAtoms = molecule_bond_atoms(query, queryBondIdx);
-        AtomIdx targetBondAtom0 = vf2state->queryCore[queryBondAtoms[0]];
-        AtomIdx targetBondAtom1 = vf2state->queryCore[queryBondAtoms[1]];
-        BondIdx targetBondIdx = molecule_get_bond(target, targetBondAtom0, targetBondAtom1);
-        uint8_t targetStereo = molecule_get_bond_stereo(target, targetBondIdx);
+static inline bool vf2state_is_bond_stereo_valid(const VF2State *restrict vf2state, BondIdx queryBondIdx)
+{
+    const Molecule *restrict query = vf2state->query;
+    const Molecule *restrict target = vf2state->target;
 
-        if(queryStereo == BOND_STEREO_UNDEFINED)
-        {
-            if(vf2state->searchMode == SEARCH_EXACT && targetStereo != BOND_STEREO_UNDEFINED)
-                return false;
-        }
-        else if(queryStereo != BOND_STEREO_NONE)
-        {
-            if(vf2state->searchMode == SEARCH_EXACT && targetStereo == BOND_STEREO_UNDEFINED)
-                return false;
+    uint8_t queryStereo = molecule_get_bond_stereo(query, queryBondIdx);
 
-            if(targetStereo == BOND_STEREO_NONE || targetStereo == BOND_STEREO_UNDEFINED)
-                continue;
+    AtomIdx *queryBondAtoms = molecule_bond_atoms(query, queryBondIdx);
+    AtomIdx targetBondAtom0 = vf2state->queryCore[queryBondAtoms[0]];
+    AtomIdx targetBondAtom1 = vf2state->queryCore[queryBondAtoms[1]];
+    BondIdx targetBondIdx = molecule_get_bond(target, targetBondAtom0, targetBondAtom1);
+    uint8_t targetStereo = molecule_get_bond_stereo(target, targetBondIdx);
 
+    if(queryStereo == BOND_STEREO_UNDEFINED)
+    {
+        if(vf2state->searchMode == SEARCH_EXACT && targetStereo != BOND_STEREO_UNDEFINED)
+            return false;
+    }
+    else if(queryStereo != BOND_STEREO_NONE)
+    {
+        if(vf2state->searchMode == SEARCH_EXACT && targetStereo == BOND_STEREO_UNDEFINED)
+            return false;
 
-            if(is_extended_cis_trans(query, queryBondIdx))
+        if(targetStereo == BOND_STEREO_NONE || targetStereo == BOND_STEREO_UNDEFINED)
+            return true;
+
+
+        if(is_extended_cis_trans(query, queryBondIdx))
+        {
+            AtomIdx queryTerminalAtoms[2];
+            AtomIdx queryPreTerminalAtoms[2];
+            AtomIdx queryAtoms[4];
+            int listSize = 0;
+
+            for(int i = 0; i < 2; i++)
             {
-                AtomIdx queryTerminalAtoms[2];
-                AtomIdx queryPreTerminalAtoms[2];
-                AtomIdx queryAtoms[4];
-                int listSize = 0;
+                AtomIdx atom = molecule_bond_atoms(query, queryBondIdx)[i];
+                AtomIdx bonded = molecule_get_other_bond_atom(query, queryBondIdx, atom);
+
 
-                for(int i = 0; i < 2; i++)
+                while(true)
                 {
-                    AtomIdx atom = molecule_bond_atoms(query, queryBondIdx)[i];
-                    AtomIdx bonded = molecule_get_other_bond_atom(query, queryBondIdx, atom);
+                    AtomIdx *newList = molecule_get_bonded_atom_list(query, bonded);
+                    MolSize newListSize = molecule_get_bonded_atom_list_size(query, bonded);
+
+                    if(newListSize == 3)
+                    {
+                        queryTerminalAtoms[i] = bonded;
+                        queryPreTerminalAtoms[i] = atom;
 
+                        for(int j = 0; j < 3; j++)
+                            if(newList[j] != atom)
+                                queryAtoms[listSize++] = newList[j];
 
-                    while(true)
+                        break;
+                    }
+                    else if(newListSize == 2)
                     {
-                        AtomIdx *newList = molecule_get_bonded_atom_list(query, bonded);
-                        MolSize newListSize = molecule_get_bonded_atom_list_size(query, bonded);
+                        AtomIdx next = molecule_get_opposite_atom(query, bonded, atom);
 
-                        if(newListSize == 3)
+                        if(molecule_get_bond_type(query, molecule_get_bond(query, bonded, next)) != BOND_DOUBLE)
                         {
                             queryTerminalAtoms[i] = bonded;
                             queryPreTerminalAtoms[i] = atom;
-
-                            for(int j = 0; j < 3; j++)
-                                if(newList[j] != atom)
-                                    queryAtoms[listSize++] = newList[j];
-
-                            break;
-                        }
-                        else if(newListSize == 2)
-                        {
-                            AtomIdx next = molecule_get_opposite_atom(query, bonded, atom);
-
-                            if(molecule_get_bond_type(query, molecule_get_bond(query, bonded, next)) != BOND_DOUBLE)
-                            {
-                                queryTerminalAtoms[i] = bonded;
-                                queryPreTerminalAtoms[i] = atom;
-                                queryAtoms[listSize++] = next;
-                                queryAtoms[listSize++] = MAX_ATOM_IDX;
-                                break;
-                            }
-
-                            atom = bonded;
-                            bonded = next;
-                        }
-                        else
-                        {
+                            queryAtoms[listSize++] = next;
+                            queryAtoms[listSize++] = MAX_ATOM_IDX;
                             break;
                         }
+
+                        atom = bonded;
+                        bonded = next;
+                    }
+                    else
+                    {
+                        break;
                     }
                 }
+            }
 
-                if(listSize < 4)
-                    continue;
+            if(listSize < 4)
+                return true;
 
-                sort_bond_atoms(queryAtoms);
+            sort_bond_atoms(queryAtoms);
 
 
-                AtomIdx targetTerminalAtom0 = vf2state->queryCore[queryTerminalAtoms[0]];
-                AtomIdx targetTerminalAtom1 = vf2state->queryCore[queryTerminalAtoms[1]];
-                AtomIdx targetPreTerminalAtom0 = vf2state->queryCore[queryPreTerminalAtoms[0]];
-                AtomIdx targetPreTerminalAtom1 = vf2state->queryCore[queryPreTerminalAtoms[1]];
+            AtomIdx targetTerminalAtom0 = vf2state->queryCore[queryTerminalAtoms[0]];
+            AtomIdx targetTerminalAtom1 = vf2state->queryCore[queryTerminalAtoms[1]];
+            AtomIdx targetPreTerminalAtom0 = vf2state->queryCore[queryPreTerminalAtoms[0]];
+            AtomIdx targetPreTerminalAtom1 = vf2state->queryCore[queryPreTerminalAtoms[1]];
 
-                AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
+            AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
 
-                for(int i = 0; i < 4; i++)
-                    if(queryAtoms[i] != MAX_ATOM_IDX)
-                        targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
+            for(int i = 0; i < 4; i++)
+                if(queryAtoms[i] != MAX_ATOM_IDX)
+                    targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
 
-                if(queryAtoms[1] == MAX_ATOM_IDX)
-                    targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom0, targetPreTerminalAtom0, targetAtoms[0]);
+            if(queryAtoms[1] == MAX_ATOM_IDX)
+                targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom0, targetPreTerminalAtom0, targetAtoms[0]);
 
-                if(queryAtoms[3] == MAX_ATOM_IDX)
-                    targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom1, targetPreTerminalAtom1, targetAtoms[2]);
+            if(queryAtoms[3] == MAX_ATOM_IDX)
+                targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetTerminalAtom1, targetPreTerminalAtom1, targetAtoms[2]);
 
-                if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
-                    return false;
-            }
-            else
-            {
-                AtomIdx *bondedAtomList0 = molecule_get_bonded_atom_list(query, queryBondAtoms[0]);
-                MolSize bondedAtomListSize0 = molecule_get_bonded_atom_list_size(query, queryBondAtoms[0]);
+            if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
+                return false;
+        }
+        else
+        {
+            AtomIdx *bondedAtomList0 = molecule_get_bonded_atom_list(query, queryBondAtoms[0]);
+            MolSize bondedAtomListSize0 = molecule_get_bonded_atom_list_size(query, queryBondAtoms[0]);
 
-                AtomIdx *bondedAtomList1 = molecule_get_bonded_atom_list(query, queryBondAtoms[1]);
-                MolSize bondedAtomListSize1 = molecule_get_bonded_atom_list_size(query, queryBondAtoms[1]);
+            AtomIdx *bondedAtomList1 = molecule_get_bonded_atom_list(query, queryBondAtoms[1]);
+            MolSize bondedAtomListSize1 = molecule_get_bonded_atom_list_size(query, queryBondAtoms[1]);
 
-                if(bondedAtomListSize0 < 2 || bondedAtomListSize1 < 2)
-                    continue;
+            if(bondedAtomListSize0 < 2 || bondedAtomListSize1 < 2)
+                return true;
 
 
-                AtomIdx queryAtoms[4];
+            AtomIdx queryAtoms[4];
 
-                int idx = 0;
+            int idx = 0;
 
-                for(int i = 0; i < bondedAtomListSize0; i++)
-                    if(bondedAtomList0[i] != queryBondAtoms[1])
-                        queryAtoms[idx++] = bondedAtomList0[i];
+            for(int i = 0; i < bondedAtomListSize0; i++)
+                if(bondedAtomList0[i] != queryBondAtoms[1])
+                    queryAtoms[idx++] = bondedAtomList0[i];
 
-                if(bondedAtomListSize0 == 2)
-                    queryAtoms[idx++] = MAX_ATOM_IDX;
+            if(bondedAtomListSize0 == 2)
+                queryAtoms[idx++] = MAX_ATOM_IDX;
 
 
-                for(int i = 0; i < bondedAtomListSize1; i++)
-                    if(bondedAtomList1[i] != queryBondAtoms[0])
-                        queryAtoms[idx++] = bondedAtomList1[i];
+            for(int i = 0; i < bondedAtomListSize1; i++)
+                if(bondedAtomList1[i] != queryBondAtoms[0])
+                    queryAtoms[idx++] = bondedAtomList1[i];
 
-                if(bondedAtomListSize1 == 2)
-                    queryAtoms[idx] = MAX_ATOM_IDX;
+            if(bondedAtomListSize1 == 2)
+                queryAtoms[idx] = MAX_ATOM_IDX;
 
-                sort_bond_atoms(queryAtoms);
+            sort_bond_atoms(queryAtoms);
 
 
-                AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
+            AtomIdx targetAtoms[4] = { -1, -1, -1, -1 };
 
-                for(int i = 0; i < 4; i++)
-                    if(queryAtoms[i] != MAX_ATOM_IDX)
-                        targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
+            for(int i = 0; i < 4; i++)
+                if(queryAtoms[i] != MAX_ATOM_IDX)
+                    targetAtoms[i] = vf2state->queryCore[queryAtoms[i]];
 
-                if(queryAtoms[1] == MAX_ATOM_IDX)
-                    targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetBondAtom0, targetBondAtom1, targetAtoms[0]);
+            if(queryAtoms[1] == MAX_ATOM_IDX)
+                targetAtoms[1] = molecule_get_last_stereo_bond_ligand(target, targetBondAtom0, targetBondAtom1, targetAtoms[0]);
 
-                if(queryAtoms[3] == MAX_ATOM_IDX)
-                    targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetBondAtom1, targetBondAtom0, targetAtoms[2]);
+            if(queryAtoms[3] == MAX_ATOM_IDX)
+                targetAtoms[3] = molecule_get_last_stereo_bond_ligand(target, targetBondAtom1, targetBondAtom0, targetAtoms[2]);
 
-                if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
-                    return false;
-            }
+            if(normalize_bond_stereo(targetAtoms, targetStereo) != queryStereo)
+                return false;
         }
     }
 
+    return true;
+}
+
+
+static inline bool vf2state_is_stereo_feasible(VF2State *restrict vf2state)
+{
+    if(likely(vf2state->stereoCheckOffsets == NULL))
+        return true;
+
+    int depth = vf2state->coreLength - 1;
+    int begin = vf2state->stereoCheckOffsets[depth];
+    int end = vf2state->stereoCheckOffsets[depth + 1];
+
+    if(likely(begin == end))
+        return true;
+
+    if(vf2state->target->deferredData != NULL)
+        molecule_decode_deferred(vf2state->target);
+
+    for(int i = begin; i < end; i++)
+    {
+        int check = vf2state->stereoChecks[i];
+
+        if(check >= 0 ? !vf2state_is_atom_stereo_valid(vf2state, check) : !vf2state_is_bond_stereo_valid(vf2state, -1 - check))
+            return false;
+    }
 
     return true;
 }
@@ -868,7 +1488,8 @@ static inline AtomIdx sgroup_get_target_atom(const VF2State *restrict vf2state,
 }
 
 
-static inline bool vf2state_match_sgroup(const VF2State *restrict vf2state, const SGroup *restrict queryGroup, const SGroup *restrict targetGroup)
+static inline bool vf2state_is_sgroup_compatible(const VF2State *restrict vf2state, const SGroup *restrict queryGroup,
+        const SGroup *restrict targetGroup)
 {
     if(vf2state->searchMode == SEARCH_EXACT)
     {
@@ -891,13 +1512,22 @@ static inline bool vf2state_match_sgroup(const VF2State *restrict vf2state, cons
     if(queryGroup->connectivity != targetGroup->connectivity)
         return false;
 
+    return true;
+}
+
+
+static inline bool vf2state_match_sgroup(const VF2State *restrict vf2state, const SGroup *restrict queryGroup, const SGroup *restrict targetGroup)
+{
+    if(!vf2state_is_sgroup_compatible(vf2state, queryGroup, targetGroup))
+        return false;
+
 
     for(int i = 0; i < queryGroup->atomCount; i++)
     {
         bool found = false;
 
         for(int j = 0; j < targetGroup->atomCount; j++)
-            if(sgroup_get_query_atom(vf2state, queryGroup->atoms[i]) == sgroup_get_query_atom(vf2state, targetGroup->atoms[j]))
+            if(sgroup_get_query_atom(vf2state, queryGroup->atoms[i]) == sgroup_get_target_atom(vf2state, targetGroup->atoms[j]))
                 found = true;
 
         if(!found)
@@ -913,8 +1543,8 @@ static inline bool vf2state_match_sgroup(const VF2State *restrict vf2state, cons
             AtomIdx q0 = sgroup_get_query_atom(vf2state, queryGroup->bonds[i][0]);
             AtomIdx q1 = sgroup_get_query_atom(vf2state, queryGroup->bonds[i][1]);
 
-            AtomIdx t0 = sgroup_get_query_atom(vf2state, targetGroup->bonds[j][0]);
-            AtomIdx t1 = sgroup_get_query_atom(vf2state, targetGroup->bonds[j][1]);
+            AtomIdx t0 = sgroup_get_target_atom(vf2state, targetGroup->bonds[j][0]);
+            AtomIdx t1 = sgroup_get_target_atom(vf2state, targetGroup->bonds[j][1]);
 
             if((q0 == t0 && q1 == t1) || (q0 == t1 && q1 == t0))
                 found = true;
@@ -978,8 +1608,121 @@ static inline bool vf2state_are_sgroups_valid(const VF2State *restrict vf2state)
 }
 
 
+static inline bool vf2state_has_sgroup_bond(const VF2State *restrict vf2state, uint64_t groups, AtomIdx atom0, AtomIdx atom1)
+{
+    while(groups != 0)
+    {
+        const SGroup *restrict group = vf2state->target->sgroups + __builtin_ctzll(groups);
+        groups &= groups - 1;
+
+        for(int i = 0; i < group->bondCount; i++)
+            if((group->bonds[i][0] == atom0 && group->bonds[i][1] == atom1) || (group->bonds[i][0] == atom1 && group->bonds[i][1] == atom0))
+                return true;
+    }
+
+    return false;
+}
+
+
+static inline bool vf2state_is_sgroup_feasible(const VF2State *restrict vf2state)
+{
+    if(likely(!vf2state->sgroupPruning))
+        return true;
+
+    AtomIdx queryIdx = vf2state->queryIdx;
+    AtomIdx targetIdx = vf2state->targetIdx;
+
+    uint64_t groups = vf2state->querySGroupAtoms[queryIdx];
+
+    while(groups != 0)
+    {
+        int g = __builtin_ctzll(groups);
+        groups &= groups - 1;
+
+        if((vf2state->sgroupCandidates[g] & vf2state->targetSGroupAtoms[targetIdx]) == 0)
+            return false;
+    }
+
+    groups = vf2state->querySGroupBonds[queryIdx];
+
+    while(groups != 0)
+    {
+        int g = __builtin_ctzll(groups);
+        groups &= groups - 1;
+
+        const SGroup *restrict group = vf2state->query->sgroups + g;
+
+        for(int i = 0; i < group->bondCount; i++)
+        {
+            AtomIdx other;
+
+            if(group->bonds[i][0] == queryIdx)
+                other = group->bonds[i][1];
+            else if(group->bonds[i][1] == queryIdx)
+                other = group->bonds[i][0];
+            else
+                continue;
+
+            if(other >= vf2state->queryAtomCount || vf2state->queryCore[other] == UNDEFINED_CORE)
+                continue;
+
+            if(!vf2state_has_sgroup_bond(vf2state, vf2state->sgroupCandidates[g], targetIdx, vf2state->queryCore[other]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+static inline bool vf2state_prepare_sgroups(VF2State *restrict vf2state, uint64_t *restrict targetSGroupAtoms,
+        uint64_t *restrict sgroupCandidates)
+{
+    const Molecule *restrict query = vf2state->query;
+    const Molecule *restrict target = vf2state->target;
+
+    vf2state->sgroupPruning = false;
+
+    if(vf2state->querySGroupAtoms == NULL || target->sgroupCount > VF2_SGROUP_BITS)
+        return true;
+
+    for(int g = 0; g < query->sgroupCount; g++)
+    {
+        sgroupCandidates[g] = 0;
+
+        for(int h = 0; h < target->sgroupCount; h++)
+            if(vf2state_is_sgroup_compatible(vf2state, query->sgroups + g, target->sgroups + h))
+                sgroupCandidates[g] |= (uint64_t) 1 << h;
+
+        if(sgroupCandidates[g] == 0)
+            return false;
+    }
+
+    for(int i = 0; i < target->atomCount; i++)
+        targetSGroupAtoms[i] = 0;
+
+    for(int h = 0; h < target->sgroupCount; h++)
+    {
+        const SGroup *restrict group = target->sgroups + h;
+
+        for(int i = 0; i < group->atomCount; i++)
+            if(group->atoms[i] < target->atomCount)
+                targetSGroupAtoms[group->atoms[i]] |= (uint64_t) 1 << h;
+    }
+
+    vf2state->targetSGroupAtoms = targetSGroupAtoms;
+    vf2state->sgroupCandidates = sgroupCandidates;
+    vf2state->sgroupPruning = true;
+
+    return true;
+}
+
+
 static inline bool vf2state_is_match_valid(const VF2State *restrict vf2state)
 {
+    if(vf2state->target->deferredData != NULL)
+        molecule_decode_deferred(vf2state->target);
+
     const Molecule *restrict query = vf2state->query;
     const Molecule *restrict target = vf2state->target;
 
@@ -1031,9 +1774,6 @@ static inline bool vf2state_is_match_valid(const VF2State *restrict vf2state)
     }
 
 
-    if(unlikely(vf2state->stereoMode == STEREO_STRICT) && !vf2state_is_stereo_valid(vf2state))
-            return false;
-
     if(unlikely(!vf2state_are_sgroups_valid(vf2state)))
             return false;
 
@@ -1041,8 +1781,13 @@ static inline bool vf2state_is_match_valid(const VF2State *restrict vf2state)
 }
 
 
-static inline bool vf2state_match_core(VF2State *restrict vf2state)
+static pg_attribute_always_inline bool vf2state_match_core(VF2State *restrict vf2state, SearchMode searchMode,
+        ChargeMode chargeMode, IsotopeMode isotopeMode, RadicalMode radicalMode)
 {
+    /* a state left at a complete match resumes the search for the next one */
+    if(vf2state->coreLength > 0 && vf2state->coreLength == vf2state->query->atomCount)
+        goto recursion_return;
+
     while(true)
     {
         recursion_entry:
@@ -1058,16 +1803,22 @@ static inline bool vf2state_match_core(VF2State *restrict vf2state)
         if(!vf2state_next_query(vf2state))
             goto recursion_return;
 
+        if(vf2state->bitParallel && !vf2state->queryDomainReady[vf2state->queryIdx] &&
+                !vf2state_compute_domain(vf2state, searchMode, chargeMode, isotopeMode, radicalMode))
+            return false;
 
-        while(vf2state_next_target(vf2state))
+
+        while(vf2state_next_target(vf2state, searchMode))
         {
             if(unlikely(--vf2state->counter == 0 || (InterruptPending && QueryCancelPending)))
                 return false;
 
-            if(vf2state_is_feasible_pair(vf2state))
+            if(vf2state_is_feasible_pair(vf2state, searchMode, chargeMode, isotopeMode, radicalMode))
             {
                 vf2state_add_pair(vf2state);
-                goto recursion_entry;
+
+                if(likely(vf2state_is_stereo_feasible(vf2state) && vf2state_is_sgroup_feasible(vf2state)))
+                    goto recursion_entry;
 
                 recursion_return:
 
@@ -1085,11 +1836,222 @@ static inline bool vf2state_match_core(VF2State *restrict vf2state)
 }
 
 
-static inline bool vf2state_match(VF2State *restrict vf2state, const Molecule *restrict target, void *memory, int64_t limit)
+#define VF2STATE_MATCH_CORE_VARIANT(name, searchMode, chargeMode, isotopeMode, radicalMode) \
+    static inline bool name(VF2State *restrict vf2state) \
+    { \
+        return vf2state_match_core(vf2state, searchMode, chargeMode, isotopeMode, radicalMode); \
+    }
+
+VF2STATE_MATCH_CORE_VARIANT(vf2state_match_core_substructure, SEARCH_SUBSTRUCTURE, CHARGE_DEFAULT_AS_ANY, ISOTOPE_IGNORE, RADICAL_IGNORE)
+VF2STATE_MATCH_CORE_VARIANT(vf2state_match_core_exact, SEARCH_EXACT, CHARGE_DEFAULT_AS_ANY, ISOTOPE_IGNORE, RADICAL_IGNORE)
+VF2STATE_MATCH_CORE_VARIANT(vf2state_match_core_generic, vf2state->searchMode, vf2state->chargeMode, vf2state->isotopeMode, vf2state->radicalMode)
+
+
+static inline bool vf2state_is_composition_feasible(const VF2State *restrict vf2state, const uint8_t *restrict data)
 {
-    vf2state->counter = limit > 0 ? limit : (uint64_t) -1;
+    const Molecule *restrict query = vf2state->query;
+
+    int xAtomCount = data[0] << 8 | data[1];
+    int cAtomCount = data[2] << 8 | data[3];
+    int hAtomCount = data[4] << 8 | data[5];
+    int xBondCount = data[6] << 8 | data[7];
+    int specialCount = data[8] << 8 | data[9];
+
+    const int8_t *restrict numbers = (const int8_t *) (data + 10);
+    bool exact = vf2state->searchMode == SEARCH_EXACT;
+
+    if(exact)
+    {
+        if(xAtomCount != query->xAtomCount || cAtomCount != vf2state->queryCAtomCount)
+            return false;
+
+        /* the x-bond count of the header includes the bonds to multivalent hydrogens */
+        if(hAtomCount != query->hydrogenAtomCount || xBondCount != vf2state->queryXBondCount)
+            return false;
+    }
+    else
+    {
+        if(query->heavyAtomCount + query->hydrogenAtomCount > xAtomCount + cAtomCount + hAtomCount)
+            return false;
+
+        if(vf2state->queryFixedXAtomCount > xAtomCount || vf2state->queryCAtomCount > cAtomCount)
+            return false;
+    }
+
+
+    for(int e = 0; e < vf2state->queryElementCount; e++)
+    {
+        int8_t number = vf2state->queryElementNumbers[e];
+
+        if(!exact && number < 0 && number != UNKNOWN_ATOM_NUMBER)
+            continue;
+
+        int count = 0;
+
+        for(int i = 0; i < xAtomCount; i++)
+            if(numbers[i] == number)
+                count++;
+
+        if(exact ? count != vf2state->queryElementCounts[e] : count < vf2state->queryElementCounts[e])
+            return false;
+    }
+
+
+    int queryChargedAtomCount = vf2state->chargeMode != CHARGE_IGNORE ? vf2state->queryChargedAtomCount : 0;
+    int queryIsotopeAtomCount = vf2state->isotopeMode != ISOTOPE_IGNORE ? vf2state->queryIsotopeAtomCount : 0;
+
+    if(exact || (queryChargedAtomCount == 0 && queryIsotopeAtomCount == 0))
+        return true;
+
+    int heavyAtomCount = xAtomCount + cAtomCount;
+    int base = 10 + xAtomCount + xBondCount * BOND_BLOCK_SIZE + hAtomCount * HBOND_BLOCK_SIZE;
+
+    for(int i = 0; i < specialCount; i++)
+    {
+        int offset = base + i * SPECIAL_BLOCK_SIZE;
+        int value = data[offset + 0] * 256 | data[offset + 1];
+        int idx = value & 0xFFF;
+
+        if(idx >= heavyAtomCount || data[offset + 2] == 0)
+            continue;
+
+        if(data[offset] >> 4 == RECORD_CHARGE)
+            queryChargedAtomCount--;
+        else if(data[offset] >> 4 == RECORD_ISOTOPE)
+            queryIsotopeAtomCount--;
+    }
+
+    return queryChargedAtomCount <= 0 && queryIsotopeAtomCount <= 0;
+}
+
+
+/*
+The screen summarizes a target in a single pass over its data, so that many queries can be checked
+against it without scanning the target for each of them. It includes all atoms and bonds of the
+target, so it stays valid for the hydrogen-extended queries.
+*/
+static inline void vf2screen_create(VF2Screen *restrict screen, const uint8_t *restrict data)
+{
+    int xAtomCount = data[0] << 8 | data[1];
+    int cAtomCount = data[2] << 8 | data[3];
+    int hAtomCount = data[4] << 8 | data[5];
+    int xBondCount = data[6] << 8 | data[7];
+
+    int heavyAtomCount = xAtomCount + cAtomCount;
+    int atomCount = heavyAtomCount + hAtomCount;
+
+    screen->atomCount = atomCount;
+    screen->xAtomCount = xAtomCount;
+    screen->cAtomCount = cAtomCount;
+    screen->ringCount = 0;
+    screen->bondFeatures = 0;
+
+    memset(screen->elementCounts, 0, sizeof(screen->elementCounts));
+    memset(screen->bondTypeCounts, 0, sizeof(screen->bondTypeCounts));
+
+    data += 10;
+
+    const int8_t *restrict numbers = (const int8_t *) data;
+
+    for(int i = 0; i < xAtomCount; i++)
+        screen->elementCounts[data[i]]++;
+
+    data += xAtomCount;
+
+
+    int components[atomCount];
+
+    for(int i = 0; i < atomCount; i++)
+        components[i] = i;
+
+    for(int i = 0; i < xBondCount; i++)
+    {
+        int offset = i * BOND_BLOCK_SIZE;
+
+        int b0 = data[offset + 0];
+        int b1 = data[offset + 1];
+        int b2 = data[offset + 2];
+
+        int x = b0 | (b1 << 4 & 0xF00);
+        int y = b2 | (b1 << 8 & 0xF00);
+        uint8_t type = data[offset + 3];
+
+        if(x >= atomCount || y >= atomCount)
+            continue;
+
+        if(!join_components(components, x, y))
+            screen->ringCount++;
+
+        if(type < VF2_SCREEN_BOND_TYPES && x < heavyAtomCount && y < heavyAtomCount)
+        {
+            screen->bondTypeCounts[type]++;
+            screen->bondFeatures |= bond_feature(x < xAtomCount ? numbers[x] : C_ATOM_NUMBER,
+                    y < xAtomCount ? numbers[y] : C_ATOM_NUMBER, type);
+        }
+    }
+
+    data += xBondCount * BOND_BLOCK_SIZE;
+
+    for(int i = 0; i < hAtomCount; i++)
+    {
+        int value = data[i * HBOND_BLOCK_SIZE + 0] * 256 | data[i * HBOND_BLOCK_SIZE + 1];
+
+        if(value != 0 && (value & 0xFFF) < atomCount && !join_components(components, value & 0xFFF, heavyAtomCount + i))
+            screen->ringCount++;
+    }
+}
 
-    if(vf2state->query->sgroups != NULL && target->sgroups == NULL)
+
+static inline bool vf2state_is_screen_feasible(const VF2State *restrict vf2state, const VF2Screen *restrict screen)
+{
+    const Molecule *restrict query = vf2state->query;
+
+    if(query->heavyAtomCount + query->hydrogenAtomCount > screen->atomCount)
+        return false;
+
+    if(vf2state->queryFixedXAtomCount > screen->xAtomCount || vf2state->queryCAtomCount > screen->cAtomCount)
+        return false;
+
+    if(vf2state->queryRingCount > screen->ringCount)
+        return false;
+
+    if((vf2state->queryBondFeatures & ~screen->bondFeatures) != 0)
+        return false;
+
+    for(int t = 0; t < VF2_SCREEN_BOND_TYPES; t++)
+        if(vf2state->queryBondTypeCounts[t] > screen->bondTypeCounts[t])
+            return false;
+
+    for(int e = 0; e < vf2state->queryElementCount; e++)
+    {
+        int8_t number = vf2state->queryElementNumbers[e];
+
+        if(number < 0 && number != UNKNOWN_ATOM_NUMBER)
+            continue;
+
+        if(vf2state->queryElementCounts[e] > screen->elementCounts[(uint8_t) number])
+            return false;
+    }
+
+    return true;
+}
+
+
+static inline void vf2state_reset(VF2State *restrict vf2state)
+{
+    vf2state->coreLength = 0;
+
+    for(int i = 0; i < vf2state->targetAtomCount; i++)
+        vf2state->targetCore[i] = UNDEFINED_CORE;
+
+    for(int i = 0; i < vf2state->queryAtomCount; i++)
+        vf2state->queryCore[i] = UNDEFINED_CORE;
+}
+
+
+static inline bool vf2state_prepare(VF2State *restrict vf2state, Molecule *restrict target, void **memory)
+{
+    if(vf2state->query->sgroups != NULL && target->sgroupCount == 0)
         return false;
 
     if(likely(vf2state->searchMode != SEARCH_EXACT))
@@ -1119,23 +2081,145 @@ static inline bool vf2state_match(VF2State *restrict vf2state, const Molecule *r
 
         if(vf2state->query->hydrogenBondCount != target->hydrogenBondCount)
             return false;
+
+        if(vf2state->query->sgroupCount != target->sgroupCount)
+            return false;
     }
 
     int targetAtomCount = target->atomCount;
 
     vf2state->target = target;
     vf2state->targetAtomCount = targetAtomCount;
-    vf2state->coreLength = 0;
+    vf2state->targetCore = (AtomIdx *) alloc_memory(memory, targetAtomCount * sizeof(AtomIdx));
+    vf2state->bitParallel = false;
 
-    vf2state->targetCore = (AtomIdx *) memory;
+    uint64_t *restrict targetSGroupAtoms = (uint64_t *) alloc_memory(memory, targetAtomCount * sizeof(uint64_t));
+    uint64_t *restrict sgroupCandidates = (uint64_t *) alloc_memory(memory, VF2_SGROUP_BITS * sizeof(uint64_t));
 
-    for(int i = 0; i < targetAtomCount; i++)
-        vf2state->targetCore[i] = UNDEFINED_CORE;
+    /*
+    The S-groups of the target are needed before the search starts: a target with no compatible
+    counterpart for some query S-group is rejected, and the remaining candidates restrict which
+    target atoms and crossing bonds can be mapped to the atoms and crossing bonds of each S-group.
+    */
 
-    for(int i = 0; i < vf2state->queryAtomCount; i++)
-        vf2state->queryCore[i] = UNDEFINED_CORE;
+    if(vf2state->querySGroupAtoms != NULL)
+    {
+        if(target->deferredData != NULL)
+            molecule_decode_deferred(target);
+
+        if(!vf2state_prepare_sgroups(vf2state, targetSGroupAtoms, sgroupCandidates))
+            return false;
+    }
+    else
+    {
+        vf2state->sgroupPruning = false;
+    }
+
+    return true;
+}
+
+
+static inline bool vf2state_match(VF2State *restrict vf2state, Molecule *restrict target, void *memory, int64_t limit)
+{
+    vf2state->counter = limit > 0 ? limit : (uint64_t) -1;
+
+    if(!vf2state_prepare(vf2state, target, &memory))
+        return false;
+
+    int targetAtomCount = target->atomCount;
+
+    /*
+    Most targets are decided within a few candidate pairs, where building the masks and the domains
+    would cost more than it saves. The bit-parallel search is therefore used only for small targets
+    that the plain search did not decide within VF2_PLAIN_ITERATIONS pairs; it restarts from scratch.
+    */
+
+    uint64_t counter = vf2state->counter;
+
+    if(targetAtomCount <= VF2_MASK_BITS && counter > VF2_PLAIN_ITERATIONS)
+    {
+        vf2state->counter = VF2_PLAIN_ITERATIONS;
+        vf2state_reset(vf2state);
+
+        if(vf2state->matchCore(vf2state))
+            return true;
+
+        if(vf2state->counter != 0)
+            return false;
+
+        VF2Mask *restrict targetAdjacency = (VF2Mask *) memory;
+
+        for(AtomIdx i = 0; i < targetAtomCount; i++)
+        {
+            AtomIdx *restrict targetBondedAtomList = molecule_get_bonded_atom_list(target, i);
+            MolSize targetBondedAtomListSize = molecule_get_bonded_atom_list_size(target, i);
+
+            targetAdjacency[i] = (VF2Mask) { { 0 } };
+
+            for(int j = 0; j < targetBondedAtomListSize; j++)
+                vf2mask_set(&targetAdjacency[i], targetBondedAtomList[j]);
+        }
+
+        vf2state->counter = counter - VF2_PLAIN_ITERATIONS;
+        vf2state->bitParallel = true;
+        vf2state->targetAdjacency = targetAdjacency;
+        vf2state->targetMapped = (VF2Mask) { { 0 } };
+
+        memset(vf2state->queryDomainReady, 0, vf2state->queryAtomCount * sizeof(bool));
+    }
+
+    vf2state_reset(vf2state);
+
+    return vf2state->matchCore(vf2state);
+}
+
+
+/*
+Enumerates the distinct sets of target atoms covered by the mappings of the query, up to the given
+number of sets, as symmetric queries map onto the same atoms in several ways. Each set is stored
+sorted into the matches array, which has room for maxMatches sets of the query atom count.
+*/
+static inline int vf2state_match_all(VF2State *restrict vf2state, Molecule *restrict target, void *memory, int64_t limit,
+        AtomIdx *restrict matches, int maxMatches)
+{
+    vf2state->counter = limit > 0 ? limit : (uint64_t) -1;
+
+    if(!vf2state_prepare(vf2state, target, &memory))
+        return 0;
+
+    vf2state_reset(vf2state);
+
+    int queryAtomCount = vf2state->queryAtomCount;
+    int count = 0;
+
+    while(count < maxMatches && vf2state->matchCore(vf2state))
+    {
+        AtomIdx *restrict match = matches + count * queryAtomCount;
+
+        for(int i = 0; i < queryAtomCount; i++)
+        {
+            AtomIdx atom = vf2state->queryCore[i];
+            int j = i;
+
+            for(; j > 0 && match[j - 1] > atom; j--)
+                match[j] = match[j - 1];
+
+            match[j] = atom;
+        }
+
+        bool included = false;
+
+        for(int m = 0; m < count && !included; m++)
+            included = memcmp(matches + m * queryAtomCount, match, queryAtomCount * sizeof(AtomIdx)) == 0;
+
+        if(!included)
+            count++;
+
+        if(queryAtomCount == 0)
+            break;
+    }
 
-    return vf2state_match_core(vf2state);
+    return count;
 }
 
 
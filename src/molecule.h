@@ -2,6 +2,7 @@
 #define MOLECULE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
 #include "memory.h"
@@ -17,11 +18,18 @@
 #define C_ATOM_NUMBER           6
 #define MAX_ATOM_IDX            INT16_MAX
 
-#define BOND_LIST_BASE_SIZE     16
 #define BOND_BLOCK_SIZE         4
 #define HBOND_BLOCK_SIZE        2
 #define SPECIAL_BLOCK_SIZE      3
 
+#define MOLECULE_IMAGE_MAGIC        0xFF
+#define MOLECULE_IMAGE_VERSION      2
+#define MOLECULE_IMAGE_HEADER_SIZE  16
+
+/* the layout of the arrays built by molecule_create, which the images store; it has to be incremented
+   whenever Molecule or molecule_create changes */
+#define MOLECULE_LAYOUT_VERSION     1
+
 
 enum BondType
 {
@@ -143,11 +151,13 @@ typedef struct
 AtomLabel;
 
 
+/* a change of the structure has to increment MOLECULE_LAYOUT_VERSION */
 typedef struct
 {
     int atomCount;
     int bondCount;
 
+    int xAtomCount;
     int heavyAtomCount;
     int heavyBondCount;
 
@@ -171,11 +181,17 @@ typedef struct
     SGroup *restrict sgroups;
     AtomLabel *restrict labels;
 
-    BondIdx *restrict bondMatrix;
-    AtomIdx *restrict bondLists;
+    int *restrict bondListOffsets;
     MolSize *restrict bondListSizes;
+    AtomIdx *restrict bondLists;
+    BondIdx *restrict bondListBonds;
 
     AtomIdx (*restrict contains)[2];
+
+    AtomIdx *restrict atomsByNumber;
+
+    const uint8_t *restrict deferredData;
+    void *deferredMemory;
 }
 Molecule;
 
@@ -207,10 +223,12 @@ static inline size_t molecule_mem_size(const uint8_t *restrict data, const uint8
     memsize += (2 + withCharges + withIsotopes + withRadicals + withStereo) * align_size(atomCount);
     memsize += (1 + withStereo) * align_size(bondCount);
 
-    memsize += align_size(BOND_LIST_BASE_SIZE * atomCount * sizeof(AtomIdx));
+    memsize += align_size(atomCount * sizeof(int));
     memsize += align_size(atomCount * sizeof(MolSize));
+    memsize += align_size(2 * bondCount * sizeof(AtomIdx));
+    memsize += align_size(2 * bondCount * sizeof(BondIdx));
     memsize += align_size(bondCount * sizeof(AtomIdx[2]));
-    memsize += align_size(atomCount * atomCount * sizeof(BondIdx));
+    memsize += align_size(atomCount * sizeof(AtomIdx));
 
     if(!extended && (ignoreChargedHydrogens || ignoreHydrogenIsotopes || ignoreHydrogenRadicals))
         memsize += align_size(sizeof(bool) * hAtomCount);
@@ -263,51 +281,48 @@ static inline size_t molecule_mem_size(const uint8_t *restrict data, const uint8
 }
 
 
-static inline size_t molecule_extended_mem_size(const Molecule *restrict molecule)
+static inline SGroup *molecule_decode_sgroups(void **memory, const uint8_t *restrict data, int sgroupCount)
 {
-    int atomCount = molecule->heavyAtomCount + molecule->hydrogenAtomCount;
-    int bondCount = molecule->heavyBondCount + molecule->hydrogenBondCount;
-    bool withCharges = molecule->atomCharges;
-    bool withIsotopes = molecule->atomMasses;
-    bool withRadicals = molecule->atomRadicalTypes;
-    bool withStereo = molecule->atomStereo;
-
-    size_t memsize = align_size(sizeof(Molecule));
-
-    if(molecule->restH != NULL)
-        memsize += align_size(atomCount * sizeof(uint8_t));
-
-    memsize += (2 + withCharges + withIsotopes + withRadicals + withStereo) * align_size(atomCount);
-    memsize += (1 + withStereo) * align_size(bondCount);
+    SGroup *sgroups = (SGroup *) alloc_memory_zero(memory, sgroupCount * sizeof(SGroup));
 
-    memsize += align_size(BOND_LIST_BASE_SIZE * atomCount * sizeof(AtomIdx));
-    memsize += align_size(atomCount * sizeof(MolSize));
-    memsize += align_size(bondCount * 2 * sizeof(AtomIdx));
-    memsize += align_size(atomCount * atomCount * sizeof(BondIdx));
+    for(int i = 0; i < sgroupCount; i++)
+    {
+        sgroups[i].type = data[5];
+        sgroups[i].subtype = data[6];
+        sgroups[i].connectivity = data[7];
 
+        sgroups[i].atomCount = data[8] * 256 | data[9];
+        sgroups[i].bondCount = data[10] * 256 | data[11];
 
-    memsize += align_size(molecule->labelCount * sizeof(AtomLabel));
+        data += 12;
 
-    for(int i = 0; i < molecule->labelCount; i++)
-        memsize += align_size(molecule->labels[i].length);
+        sgroups[i].atoms = (AtomIdx *) alloc_memory_zero(memory, sgroups[i].atomCount * sizeof(AtomIdx));
+        sgroups[i].bonds = (AtomIdx (*)[2]) alloc_memory_zero(memory, sgroups[i].bondCount * 2 * sizeof(AtomIdx));
 
+        for(int a = 0; a < sgroups[i].atomCount; a++)
+        {
+            sgroups[i].atoms[a] = data[0] * 256 | data[1];
+            data += 2;
+        }
 
-    memsize += align_size(molecule->sgroupCount * sizeof(SGroup));
-
-    for(int i = 0; i < molecule->sgroupCount; i++)
-    {
-        memsize += align_size(molecule->sgroups[i].atomCount * sizeof(AtomIdx));
-        memsize += align_size(molecule->sgroups[i].bondCount * 2 * sizeof(AtomIdx));
+        for(int b = 0; b < sgroups[i].bondCount; b++)
+        {
+            sgroups[i].bonds[b][0] = data[0] * 256 | data[1];
+            sgroups[i].bonds[b][1] = data[2] * 256 | data[3];
+            data += 4;
+        }
     }
 
-    return memsize;
+    return sgroups;
 }
 
 
 static inline Molecule *molecule_create(void *memory, const uint8_t *restrict data, uint8_t *restrict restData,
         bool extended, bool withCharges, bool withIsotopes, bool withRadicals, bool withStereo, bool withSGroup,
-        bool ignoreChargedHydrogens, bool ignoreHydrogenIsotopes, bool ignoreHydrogenRadicals)
+        bool ignoreChargedHydrogens, bool ignoreHydrogenIsotopes, bool ignoreHydrogenRadicals, bool lazy)
 {
+    const uint8_t *restrict record = data;
+
     ignoreChargedHydrogens &= !extended;
     ignoreHydrogenIsotopes &= !extended;
     ignoreHydrogenRadicals &= !extended;
@@ -361,13 +376,26 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
     int8_t *restrict atomCharges = withCharges ? (int8_t *) alloc_memory_zero(&memory, atomCount) : NULL;
     int8_t *restrict atomMasses = withIsotopes ? (int8_t *) alloc_memory_zero(&memory, atomCount) : NULL;
     int8_t *restrict atomRadicalTypes = withRadicals ? (int8_t *) alloc_memory_zero(&memory, atomCount) : NULL;
-    uint8_t *restrict atomStereo = withStereo ? (uint8_t *) alloc_memory_zero(&memory, atomCount) : NULL;
-    uint8_t *restrict bondStereo = withStereo ? (uint8_t *) alloc_memory_zero(&memory, bondCount) : NULL;
+    uint8_t *restrict atomStereo = NULL;
+    uint8_t *restrict bondStereo = NULL;
 
-    AtomIdx *restrict bondLists = (AtomIdx *) alloc_memory(&memory, BOND_LIST_BASE_SIZE * atomCount * sizeof(AtomIdx));
+    if(withStereo && lazy)
+    {
+        atomStereo = (uint8_t *) alloc_memory(&memory, atomCount);
+        bondStereo = (uint8_t *) alloc_memory(&memory, bondCount);
+    }
+    else if(withStereo)
+    {
+        atomStereo = (uint8_t *) alloc_memory_zero(&memory, atomCount);
+        bondStereo = (uint8_t *) alloc_memory_zero(&memory, bondCount);
+    }
+
+    int *restrict bondListOffsets = (int *) alloc_memory(&memory, atomCount * sizeof(int));
     MolSize *restrict bondListSizes = (MolSize *) alloc_memory_zero(&memory, atomCount * sizeof(MolSize));
+    AtomIdx *restrict bondLists = (AtomIdx *) alloc_memory(&memory, 2 * bondCount * sizeof(AtomIdx));
+    BondIdx *restrict bondListBonds = (BondIdx *) alloc_memory(&memory, 2 * bondCount * sizeof(BondIdx));
     AtomIdx (*restrict contains)[2] = (AtomIdx (*)[2]) alloc_memory(&memory, bondCount * sizeof(AtomIdx[2]));
-    BondIdx *restrict bondMatrix = (BondIdx *) alloc_memory_one(&memory, atomCount * atomCount * sizeof(BondIdx));
+    AtomIdx *restrict atomsByNumber = (AtomIdx *) alloc_memory(&memory, atomCount * sizeof(AtomIdx));
 
 
     for(int i = 0; i < xAtomCount; i++)
@@ -383,9 +411,65 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
         if(atomNumbers[i] == UNKNOWN_ATOM_NUMBER)
             labelCount++;
 
+    for(int i = 0; i < atomCount; i++)
+        atomsByNumber[i] = (AtomIdx) i;
+
+    for(int i = 1; i < xAtomCount; i++)
+    {
+        AtomIdx atom = atomsByNumber[i];
+        int j = i;
+
+        for(; j > 0 && atomNumbers[atomsByNumber[j - 1]] > atomNumbers[atom]; j--)
+            atomsByNumber[j] = atomsByNumber[j - 1];
+
+        atomsByNumber[j] = atom;
+    }
+
     data += xAtomCount;
 
 
+    for(int i = 0; i < xBondCount; i++)
+    {
+        int offset = i * BOND_BLOCK_SIZE;
+
+        int b0 = data[offset + 0];
+        int b1 = data[offset + 1];
+        int b2 = data[offset + 2];
+
+        AtomIdx x = (AtomIdx) (b0 | (b1 << 4 & 0xF00));
+        AtomIdx y = (AtomIdx) (b2 | (b1 << 8 & 0xF00));
+
+        if(x < atomCount && y < atomCount)
+        {
+            bondListSizes[x]++;
+            bondListSizes[y]++;
+        }
+    }
+
+    if(extended)
+    {
+        const uint8_t *hdata = data + xBondCount * BOND_BLOCK_SIZE;
+
+        for(int i = 0; i < hAtomCount; i++)
+        {
+            int value = hdata[i * HBOND_BLOCK_SIZE + 0] * 256 | hdata[i * HBOND_BLOCK_SIZE + 1];
+
+            if(value != 0)
+            {
+                bondListSizes[value & 0xFFF]++;
+                bondListSizes[heavyAtomCount + i]++;
+            }
+        }
+    }
+
+    for(int i = 0, offset = 0; i < atomCount; i++)
+    {
+        bondListOffsets[i] = offset;
+        offset += bondListSizes[i];
+        bondListSizes[i] = 0;
+    }
+
+
     BondIdx boundIdx = 0;
 
     for(int i = 0; i < xBondCount; i++)
@@ -419,14 +503,10 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
             continue;
         }
 
-        bondLists[x * BOND_LIST_BASE_SIZE + bondListSizes[x]++] = y;
-        bondLists[y * BOND_LIST_BASE_SIZE + bondListSizes[y]++] = x;
-
-        if(unlikely(bondListSizes[x] == BOND_LIST_BASE_SIZE || bondListSizes[y] == BOND_LIST_BASE_SIZE))
-            return NULL;
-
-        bondMatrix[x * atomCount + y] = boundIdx;
-        bondMatrix[y * atomCount + x] = boundIdx;
+        bondListBonds[bondListOffsets[x] + bondListSizes[x]] = boundIdx;
+        bondLists[bondListOffsets[x] + bondListSizes[x]++] = y;
+        bondListBonds[bondListOffsets[y] + bondListSizes[y]] = boundIdx;
+        bondLists[bondListOffsets[y] + bondListSizes[y]++] = x;
 
         contains[boundIdx][0] = x;
         contains[boundIdx][1] = y;
@@ -503,14 +583,10 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
             bondTypes[boundIdx] = (uint8_t ) (data[offset] >> 4);
 
 
-            bondLists[idx * BOND_LIST_BASE_SIZE + bondListSizes[idx]++] = idy;
-            bondLists[idy * BOND_LIST_BASE_SIZE + bondListSizes[idy]++] = idx;
-
-            if(unlikely(bondListSizes[idx] == BOND_LIST_BASE_SIZE || bondListSizes[idy] == BOND_LIST_BASE_SIZE))
-                return NULL;
-
-            bondMatrix[idx * atomCount + idy] = boundIdx;
-            bondMatrix[idy * atomCount + idx] = boundIdx;
+            bondListBonds[bondListOffsets[idx] + bondListSizes[idx]] = boundIdx;
+            bondLists[bondListOffsets[idx] + bondListSizes[idx]++] = idy;
+            bondListBonds[bondListOffsets[idy] + bondListSizes[idy]] = boundIdx;
+            bondLists[bondListOffsets[idy] + bondListSizes[idy]++] = idx;
 
             contains[boundIdx][0] = idx;
             contains[boundIdx][1] = idy;
@@ -547,12 +623,12 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
                 break;
 
             case RECORD_TETRAHEDRAL_STEREO:
-                if(withStereo && idx < atomCount)
+                if(withStereo && !lazy && idx < atomCount)
                     atomStereo[idx] = data[offset + 2];
                 break;
 
             case RECORD_BOND_STEREO:
-                if(withStereo && idx < xBondCount) // not for H bond
+                if(withStereo && !lazy && idx < xBondCount) // not for H bond
                     bondStereo[idx] = data[offset + 2];
                 break;
 
@@ -566,6 +642,9 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
     data += specialCount * SPECIAL_BLOCK_SIZE;
 
 
+    Molecule *restrict molecule = alloc_memory(&memory, sizeof(Molecule));
+
+
     AtomLabel *labels = NULL;
 
     if(labelCount > 0)
@@ -585,44 +664,13 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
 
     SGroup *sgroups = NULL;
 
-    if(sgroupCount > 0)
-    {
-        sgroups = (SGroup *) alloc_memory_zero(&memory, sgroupCount * sizeof(SGroup));
-
-        for(int i = 0; i < sgroupCount; i++)
-        {
-            sgroups[i].type = data[5];
-            sgroups[i].subtype = data[6];
-            sgroups[i].connectivity = data[7];
-
-            sgroups[i].atomCount = data[8] * 256 | data[9];
-            sgroups[i].bondCount = data[10] * 256 | data[11];
-
-            data += 12;
+    if(sgroupCount > 0 && !lazy)
+        sgroups = molecule_decode_sgroups(&memory, data, sgroupCount);
 
-            sgroups[i].atoms = (AtomIdx *) alloc_memory_zero(&memory, sgroups[i].atomCount * sizeof(AtomIdx));
-            sgroups[i].bonds = (AtomIdx (*)[2]) alloc_memory_zero(&memory, sgroups[i].bondCount * 2 * sizeof(AtomIdx));
-
-            for(int a = 0; a < sgroups[i].atomCount; a++)
-            {
-                sgroups[i].atoms[a] = data[0] * 256 | data[1];
-                data += 2;
-            }
-
-            for(int b = 0; b < sgroups[i].bondCount; b++)
-            {
-                sgroups[i].bonds[b][0] = data[0] * 256 | data[1];
-                sgroups[i].bonds[b][1] = data[2] * 256 | data[3];
-                data += 4;
-            }
-        }
-    }
-
-
-    Molecule *restrict molecule = alloc_memory(&memory, sizeof(Molecule));
 
     molecule->atomCount = atomCount;
     molecule->bondCount = bondCount;
+    molecule->xAtomCount = xAtomCount;
     molecule->heavyAtomCount = heavyAtomCount;
     molecule->heavyBondCount = heavyBondCount;
     molecule->hydrogenAtomCount = hydrogenAtomCount;
@@ -641,21 +689,75 @@ static inline Molecule *molecule_create(void *memory, const uint8_t *restrict da
     molecule->restH = restH;
     molecule->sgroups = sgroups;
     molecule->labels = labels;
-    molecule->bondLists = bondLists;
+    molecule->bondListOffsets = bondListOffsets;
     molecule->bondListSizes = bondListSizes;
+    molecule->bondLists = bondLists;
+    molecule->bondListBonds = bondListBonds;
     molecule->contains = contains;
-    molecule->bondMatrix = bondMatrix;
+    molecule->atomsByNumber = atomsByNumber;
+    molecule->deferredData = lazy && (withStereo || sgroupCount > 0) ? record : NULL;
+    molecule->deferredMemory = memory;
 
     return molecule;
 }
 
 
+static inline void molecule_decode_deferred(Molecule *restrict molecule)
+{
+    const uint8_t *restrict data = molecule->deferredData;
+    void *memory = molecule->deferredMemory;
+
+    int xAtomCount = data[0] << 8 | data[1];
+    int hAtomCount = data[4] << 8 | data[5];
+    int xBondCount = data[6] << 8 | data[7];
+    int specialCount = data[8] << 8 | data[9];
+
+    int atomCount = molecule->atomCount;
+    int bondCount = molecule->extended ? xBondCount + hAtomCount : xBondCount;
+
+    data += 10 + xAtomCount + xBondCount * BOND_BLOCK_SIZE + hAtomCount * HBOND_BLOCK_SIZE;
+
+
+    if(molecule->atomStereo != NULL)
+    {
+        memset(molecule->atomStereo, 0, align_size(atomCount));
+        memset(molecule->bondStereo, 0, align_size(bondCount));
+
+        for(int i = 0; i < specialCount; i++)
+        {
+            int offset = i * SPECIAL_BLOCK_SIZE;
+            int value = data[offset + 0] * 256 | data[offset + 1];
+            int idx = value & 0xFFF;
+
+            if(data[offset] >> 4 == RECORD_TETRAHEDRAL_STEREO && idx < atomCount)
+                molecule->atomStereo[idx] = data[offset + 2];
+            else if(data[offset] >> 4 == RECORD_BOND_STEREO && idx < xBondCount) // not for H bond
+                molecule->bondStereo[idx] = data[offset + 2];
+        }
+    }
+
+    data += specialCount * SPECIAL_BLOCK_SIZE;
+
+
+    if(molecule->sgroupCount > 0)
+    {
+        for(int i = 0; i < molecule->labelCount; i++)
+            data += data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+
+        molecule->sgroups = molecule_decode_sgroups(&memory, data, molecule->sgroupCount);
+    }
+
+    molecule->deferredData = NULL;
+}
+
+
 static inline Molecule *molecule_extend(void *memory, const Molecule *restrict template)
 {
     Molecule *restrict molecule = alloc_memory(&memory, sizeof(Molecule));
 
     molecule->atomCount = template->heavyAtomCount + template->hydrogenAtomCount;
     molecule->bondCount = template->heavyBondCount + template->hydrogenBondCount;
+    molecule->xAtomCount = template->xAtomCount;
     molecule->heavyAtomCount = template->heavyAtomCount;
     molecule->heavyBondCount = template->heavyBondCount;
     molecule->hydrogenAtomCount = template->hydrogenAtomCount;
@@ -740,21 +842,37 @@ static inline Molecule *molecule_extend(void *memory, const Molecule *restrict t
         molecule->bondStereo = NULL;
     }
 
-    molecule->bondLists = (AtomIdx *) alloc_memory(&memory, BOND_LIST_BASE_SIZE * molecule->atomCount * sizeof(AtomIdx));
-    memcpy(molecule->bondLists, template->bondLists, BOND_LIST_BASE_SIZE * template->atomCount * sizeof(AtomIdx));
+    molecule->bondListOffsets = (int *) alloc_memory(&memory, molecule->atomCount * sizeof(int));
+    molecule->bondListSizes = (MolSize *) alloc_memory(&memory, molecule->atomCount * sizeof(MolSize));
+    molecule->bondLists = (AtomIdx *) alloc_memory(&memory, 2 * molecule->bondCount * sizeof(AtomIdx));
+    molecule->bondListBonds = (BondIdx *) alloc_memory(&memory, 2 * molecule->bondCount * sizeof(BondIdx));
 
-    molecule->bondListSizes = (MolSize *) alloc_memory_zero(&memory, molecule->atomCount * sizeof(MolSize));
-    memcpy(molecule->bondListSizes, template->bondListSizes, template->atomCount * sizeof(MolSize));
-    memset(molecule->bondListSizes + template->atomCount, 0, template->hydrogenAtomCount * sizeof(MolSize));
+    for(int i = 0, offset = 0; i < molecule->atomCount; i++)
+    {
+        int size = 1;
+
+        if(i < template->atomCount)
+        {
+            size = template->bondListSizes[i];
+
+            memcpy(molecule->bondLists + offset, template->bondLists + template->bondListOffsets[i], size * sizeof(AtomIdx));
+            memcpy(molecule->bondListBonds + offset, template->bondListBonds + template->bondListOffsets[i], size * sizeof(BondIdx));
+            size += template->atomHydrogens[i];
+        }
+
+        molecule->bondListOffsets[i] = offset;
+        molecule->bondListSizes[i] = i < template->atomCount ? template->bondListSizes[i] : 0;
+        offset += size;
+    }
 
     molecule->contains = (AtomIdx (*)[2]) alloc_memory(&memory, molecule->bondCount * 2 * sizeof(AtomIdx));
     memcpy(molecule->contains, template->contains, template->bondCount * 2 * sizeof(AtomIdx));
 
-    molecule->bondMatrix = (BondIdx *) alloc_memory_one(&memory, molecule->atomCount * molecule->atomCount * sizeof(BondIdx));
+    molecule->atomsByNumber = (AtomIdx *) alloc_memory(&memory, molecule->atomCount * sizeof(AtomIdx));
+    memcpy(molecule->atomsByNumber, template->atomsByNumber, template->atomCount * sizeof(AtomIdx));
 
-    for(int i = 0; i < template->atomCount; i++)
-        for(int j = 0; j < template->atomCount; j++)
-            molecule->bondMatrix[i * molecule->atomCount + j] = template->bondMatrix[i * template->atomCount + j];
+    for(int i = template->atomCount; i < molecule->atomCount; i++)
+        molecule->atomsByNumber[i] = (AtomIdx) i;
 
 
     int hydrogen = template->atomCount;
@@ -764,14 +882,10 @@ static inline Molecule *molecule_extend(void *memory, const Molecule *restrict t
     {
         for(int h = 0; h < template->atomHydrogens[a]; h++)
         {
-            molecule->bondLists[a * BOND_LIST_BASE_SIZE + molecule->bondListSizes[a]++] = hydrogen;
-            molecule->bondLists[hydrogen * BOND_LIST_BASE_SIZE + molecule->bondListSizes[hydrogen]++] = a;
-
-            if(unlikely(molecule->bondListSizes[hydrogen] == BOND_LIST_BASE_SIZE || molecule->bondListSizes[hydrogen] == BOND_LIST_BASE_SIZE))
-                return NULL;
-
-            molecule->bondMatrix[a * molecule->atomCount + hydrogen] = boundIdx;
-            molecule->bondMatrix[hydrogen * molecule->atomCount + a] = boundIdx;
+            molecule->bondListBonds[molecule->bondListOffsets[a] + molecule->bondListSizes[a]] = boundIdx;
+            molecule->bondLists[molecule->bondListOffsets[a] + molecule->bondListSizes[a]++] = hydrogen;
+            molecule->bondListBonds[molecule->bondListOffsets[hydrogen] + molecule->bondListSizes[hydrogen]] = boundIdx;
+            molecule->bondLists[molecule->bondListOffsets[hydrogen] + molecule->bondListSizes[hydrogen]++] = a;
 
             molecule->contains[boundIdx][0] = a;
             molecule->contains[boundIdx][1] = hydrogen;
@@ -822,6 +936,143 @@ static inline Molecule *molecule_extend(void *memory, const Molecule *restrict t
         }
     }
 
+    molecule->deferredData = NULL;
+    molecule->deferredMemory = NULL;
+
+    return molecule;
+}
+
+
+static inline void molecule_rebase(Molecule *restrict molecule, uintptr_t delta)
+{
+#define rebase_pointer(pointer) if((pointer) != NULL) (pointer) = (void *) ((uintptr_t) (pointer) + delta)
+    rebase_pointer(molecule->atomNumbers);
+    rebase_pointer(molecule->atomHydrogens);
+    rebase_pointer(molecule->atomCharges);
+    rebase_pointer(molecule->atomMasses);
+    rebase_pointer(molecule->atomRadicalTypes);
+    rebase_pointer(molecule->atomStereo);
+    rebase_pointer(molecule->bondTypes);
+    rebase_pointer(molecule->bondStereo);
+    rebase_pointer(molecule->bondListOffsets);
+    rebase_pointer(molecule->bondListSizes);
+    rebase_pointer(molecule->bondLists);
+    rebase_pointer(molecule->bondListBonds);
+    rebase_pointer(molecule->contains);
+    rebase_pointer(molecule->atomsByNumber);
+#undef rebase_pointer
+}
+
+
+static inline bool molecule_is_image(const uint8_t *restrict data)
+{
+    return data[0] == MOLECULE_IMAGE_MAGIC;
+}
+
+
+static inline const uint8_t *molecule_image_get_data(const uint8_t *restrict image)
+{
+    return image + MOLECULE_IMAGE_HEADER_SIZE;
+}
+
+
+static inline uint32_t molecule_image_get_field(const uint8_t *restrict image, int offset)
+{
+    uint32_t value;
+    memcpy(&value, image + offset, sizeof(uint32_t));
+    return value;
+}
+
+
+/*
+Combines the explicit layout version with the size and the field offsets of Molecule, so that images of
+a build with a reordered structure are rejected even if the version has not been incremented.
+*/
+static inline uint32_t molecule_image_layout()
+{
+    const size_t offsets[] = {
+            offsetof(Molecule, atomCount), offsetof(Molecule, bondCount), offsetof(Molecule, xAtomCount),
+            offsetof(Molecule, heavyAtomCount), offsetof(Molecule, heavyBondCount),
+            offsetof(Molecule, hydrogenAtomCount), offsetof(Molecule, hydrogenBondCount),
+            offsetof(Molecule, sgroupCount), offsetof(Molecule, labelCount), offsetof(Molecule, extended),
+            offsetof(Molecule, atomNumbers), offsetof(Molecule, atomHydrogens), offsetof(Molecule, atomCharges),
+            offsetof(Molecule, atomMasses), offsetof(Molecule, atomRadicalTypes), offsetof(Molecule, atomStereo),
+            offsetof(Molecule, bondTypes), offsetof(Molecule, bondStereo), offsetof(Molecule, restH),
+            offsetof(Molecule, sgroups), offsetof(Molecule, labels), offsetof(Molecule, bondListOffsets),
+            offsetof(Molecule, bondListSizes), offsetof(Molecule, bondLists), offsetof(Molecule, bondListBonds),
+            offsetof(Molecule, contains), offsetof(Molecule, atomsByNumber), offsetof(Molecule, deferredData),
+            offsetof(Molecule, deferredMemory), sizeof(Molecule), sizeof(SGroup), sizeof(AtomLabel) };
+
+    uint32_t layout = MOLECULE_LAYOUT_VERSION;
+
+    for(size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+        layout = layout * 31 + (uint32_t) offsets[i];
+
+    return layout;
+}
+
+
+static inline bool molecule_image_is_compatible(const uint8_t *restrict image)
+{
+    return image[1] == MOLECULE_IMAGE_VERSION && (image[2] << 8 | image[3]) == MOLECULE_LAYOUT_VERSION &&
+            molecule_image_get_field(image, 4) == molecule_image_layout();
+}
+
+
+static inline size_t molecule_image_length(const uint8_t *restrict image)
+{
+    return molecule_image_get_field(image, 12);
+}
+
+
+static inline size_t molecule_image_size(const uint8_t *restrict data, int length)
+{
+    int xAtomCount = data[0] << 8 | data[1];
+
+    for(int i = 0; i < xAtomCount; i++)
+        if((int8_t) data[10 + i] == UNKNOWN_ATOM_NUMBER)
+            return 0;
+
+    return align_size(MOLECULE_IMAGE_HEADER_SIZE + length) +
+            molecule_mem_size(data, NULL, false, true, true, true, true, false, false, false, false);
+}
+
+
+static inline void molecule_image_create(uint8_t *restrict image, const uint8_t *restrict data, int length)
+{
+    uint32_t blockOffset = align_size(MOLECULE_IMAGE_HEADER_SIZE + length);
+
+    memset(image, 0, MOLECULE_IMAGE_HEADER_SIZE);
+    memcpy(image + MOLECULE_IMAGE_HEADER_SIZE, data, length);
+
+    Molecule *molecule = molecule_create(image + blockOffset, data, NULL, false, true, true, true, true, false,
+            false, false, false, false);
+
+    molecule->deferredMemory = NULL;
+    molecule_rebase(molecule, -(uintptr_t) image);
+
+    uint32_t layout = molecule_image_layout();
+    uint32_t moleculeSize = sizeof(Molecule);
+    uint32_t moleculeOffset = (uint8_t *) molecule - image;
+    uint32_t imageLength = moleculeOffset + moleculeSize;
+
+    image[0] = MOLECULE_IMAGE_MAGIC;
+    image[1] = MOLECULE_IMAGE_VERSION;
+    image[2] = MOLECULE_LAYOUT_VERSION >> 8;
+    image[3] = MOLECULE_LAYOUT_VERSION & 0xFF;
+    memcpy(image + 4, &layout, sizeof(uint32_t));
+    memcpy(image + 8, &moleculeOffset, sizeof(uint32_t));
+    memcpy(image + 12, &imageLength, sizeof(uint32_t));
+}
+
+
+static inline Molecule *molecule_image_attach(void *memory, const uint8_t *restrict image)
+{
+    Molecule *restrict molecule = alloc_memory(&memory, sizeof(Molecule));
+
+    memcpy(molecule, image + molecule_image_get_field(image, 8), sizeof(Molecule));
+    molecule_rebase(molecule, (uintptr_t) image);
+
     return molecule;
 }
 
@@ -1126,7 +1377,13 @@ static inline int8_t molecule_get_atom_radical_type(const Molecule *restrict mol
 
 static inline AtomIdx *molecule_get_bonded_atom_list(const Molecule *restrict molecule, AtomIdx atom)
 {
-    return molecule->bondLists + atom * BOND_LIST_BASE_SIZE;
+    return molecule->bondLists + molecule->bondListOffsets[atom];
+}
+
+
+static inline BondIdx *molecule_get_bonded_bond_list(const Molecule *restrict molecule, AtomIdx atom)
+{
+    return molecule->bondListBonds + molecule->bondListOffsets[atom];
 }
 
 
@@ -1136,6 +1393,34 @@ static inline MolSize molecule_get_bonded_atom_list_size(const Molecule *restric
 }
 
 
+static inline AtomIdx *molecule_get_atoms_by_number(const Molecule *restrict molecule, int8_t number, int *restrict size)
+{
+    if(number == C_ATOM_NUMBER)
+    {
+        *size = molecule->heavyAtomCount - molecule->xAtomCount;
+        return molecule->atomsByNumber + molecule->xAtomCount;
+    }
+    else if(number == H_ATOM_NUMBER)
+    {
+        *size = molecule->atomCount - molecule->heavyAtomCount;
+        return molecule->atomsByNumber + molecule->heavyAtomCount;
+    }
+
+    int begin = 0;
+
+    while(begin < molecule->xAtomCount && molecule->atomNumbers[molecule->atomsByNumber[begin]] < number)
+        begin++;
+
+    int end = begin;
+
+    while(end < molecule->xAtomCount && molecule->atomNumbers[molecule->atomsByNumber[end]] == number)
+        end++;
+
+    *size = end - begin;
+    return molecule->atomsByNumber + begin;
+}
+
+
 static inline bool molecule_has_restH_flags(const Molecule *restrict molecule)
 {
     return molecule->restH != NULL;
@@ -1188,7 +1473,21 @@ static inline AtomIdx molecule_get_opposite_atom(const Molecule *restrict molecu
 
 static inline BondIdx molecule_get_bond(const Molecule *restrict molecule, AtomIdx i, AtomIdx j)
 {
-    return molecule->bondMatrix[i * molecule->atomCount + j];
+    if(molecule->bondListSizes[i] > molecule->bondListSizes[j])
+    {
+        AtomIdx k = i;
+        i = j;
+        j = k;
+    }
+
+    const AtomIdx *restrict list = molecule->bondLists + molecule->bondListOffsets[i];
+    MolSize listSize = molecule->bondListSizes[i];
+
+    for(int k = 0; k < listSize; k++)
+        if(list[k] == j)
+            return molecule->bondListBonds[molecule->bondListOffsets[i] + k];
+
+    return -1;
 }
 
 
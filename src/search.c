@@ -47,6 +47,7 @@ static jmethodID getMessageMethod;
 static jmethodID getMethod;
 static jmethodID indexSizeMethod;
 static jmethodID subsearchMethod;
+static jmethodID subexplainMethod;
 static jmethodID simsearchMethod;
 static jmethodID similarityMethod;
 static jfieldID nameField;
@@ -262,6 +263,9 @@ static void lucene_search_init(void)
     subsearchMethod = (*env)->GetMethodID(env, searcherClass, "subsearch", "([BIZLcz/iocb/sachem/molecule/SearchMode;Lcz/iocb/sachem/molecule/ChargeMode;Lcz/iocb/sachem/molecule/IsotopeMode;Lcz/iocb/sachem/molecule/RadicalMode;Lcz/iocb/sachem/molecule/StereoMode;Lcz/iocb/sachem/molecule/AromaticityMode;Lcz/iocb/sachem/molecule/TautomerMode;J)Lcz/iocb/sachem/lucene/SearchResult;");
     java_check_exception(__func__);
 
+    subexplainMethod = (*env)->GetMethodID(env, searcherClass, "subexplain", "([BLcz/iocb/sachem/molecule/SearchMode;Lcz/iocb/sachem/molecule/ChargeMode;Lcz/iocb/sachem/molecule/IsotopeMode;Lcz/iocb/sachem/molecule/RadicalMode;Lcz/iocb/sachem/molecule/StereoMode;Lcz/iocb/sachem/molecule/AromaticityMode;Lcz/iocb/sachem/molecule/TautomerMode;)Ljava/lang/String;");
+    java_check_exception(__func__);
+
     simsearchMethod = (*env)->GetMethodID(env, searcherClass, "simsearch", "([BIZFILcz/iocb/sachem/molecule/AromaticityMode;Lcz/iocb/sachem/molecule/TautomerMode;)Lcz/iocb/sachem/lucene/SearchResult;");
     java_check_exception(__func__);
 
@@ -680,6 +684,71 @@ Datum substructure_search(PG_FUNCTION_ARGS)
 }
 
 
+PG_FUNCTION_INFO_V1(substructure_explain);
+Datum substructure_explain(PG_FUNCTION_ARGS)
+{
+    VarChar *index = PG_GETARG_VARCHAR_P(0);
+    VarChar *query = PG_GETARG_VARCHAR_P(1);
+    Oid search = PG_GETARG_OID(2);
+    Oid charge = PG_GETARG_OID(3);
+    Oid isotope = PG_GETARG_OID(4);
+    Oid radical = PG_GETARG_OID(5);
+    Oid stereo = PG_GETARG_OID(6);
+    Oid aromaticity = PG_GETARG_OID(7);
+    Oid tautomers = PG_GETARG_OID(8);
+
+    jobject lucene = lucene_get(index);
+    jbyteArray queryArray = NULL;
+    jstring plan = NULL;
+    text *result;
+
+    PG_TRY();
+    {
+        size_t length = VARSIZE(query) - VARHDRSZ;
+
+        queryArray = (jbyteArray) (*env)->NewByteArray(env, length);
+        java_check_exception(__func__);
+
+        (*env)->SetByteArrayRegion(env, queryArray, 0, length, (jbyte *) VARDATA(query));
+        java_check_exception(__func__);
+
+        plan = (jstring) (*env)->CallObjectMethod(env, lucene, subexplainMethod, queryArray,
+                ConvertEnumValue(searchModeTable, search),
+                ConvertEnumValue(chargeModeTable, charge),
+                ConvertEnumValue(isotopeModeTable, isotope),
+                ConvertEnumValue(radicalModeTable, radical),
+                ConvertEnumValue(stereoModeTable, stereo),
+                ConvertEnumValue(aromaticityModeTable,  aromaticity),
+                ConvertEnumValue(tautomerModeTable,  tautomers));
+
+        java_check_exception(__func__);
+
+        const char *pstr = (*env)->GetStringUTFChars(env, plan, NULL);
+
+        if(pstr == NULL)
+            elog(ERROR, "out of memmory");
+
+        result = cstring_to_text(pstr);
+        (*env)->ReleaseStringUTFChars(env, plan, pstr);
+
+        JavaDeleteRef(plan);
+        JavaDeleteRef(queryArray);
+        lucene_free(lucene);
+    }
+    PG_CATCH();
+    {
+        JavaDeleteRef(plan);
+        JavaDeleteRef(queryArray);
+        lucene_free(lucene);
+
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    PG_RETURN_TEXT_P(result);
+}
+
+
 PG_FUNCTION_INFO_V1(similarity_search);
 Datum similarity_search(PG_FUNCTION_ARGS)
 {
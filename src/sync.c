@@ -36,7 +36,7 @@ static void indexer_java_init()
     constructor = (*env)->GetMethodID(env, indexerClass, "<init>", "()V");
     java_check_exception(__func__);
 
-    beginMethod = (*env)->GetMethodID(env, indexerClass, "begin", "(Ljava/lang/String;IID)V");
+    beginMethod = (*env)->GetMethodID(env, indexerClass, "begin", "(Ljava/lang/String;IIDZZ)Z");
     java_check_exception(__func__);
 
     addMethod = (*env)->GetMethodID(env, indexerClass, "add", "(I[B)Ljava/lang/String;");
@@ -72,16 +72,19 @@ static void indexer_terminate(jobject indexer)
 }
 
 
-static void indexer_begin(jobject indexer, const char *path, int segments, int bufferedDocs, double bufferSize)
+static bool indexer_begin(jobject indexer, const char *path, int segments, int bufferedDocs, double bufferSize, bool matchImages,
+        bool denseFingerprints)
 {
     jstring folder = NULL;
+    jboolean rebuild = JNI_FALSE;
 
     PG_TRY();
     {
         folder = (*env)->NewStringUTF(env, path);
         java_check_exception(__func__);
 
-        (*env)->CallVoidMethod(env, indexer, beginMethod, folder, segments, bufferedDocs, bufferSize);
+        rebuild = (*env)->CallBooleanMethod(env, indexer, beginMethod, folder, segments, bufferedDocs, bufferSize, (jboolean) matchImages,
+                (jboolean) denseFingerprints);
         java_check_exception(__func__);
 
         JavaDeleteRef(folder);
@@ -93,6 +96,8 @@ static void indexer_begin(jobject indexer, const char *path, int segments, int b
         PG_RE_THROW();
     }
     PG_END_TRY();
+
+    return rebuild == JNI_TRUE;
 }
 
 
@@ -294,12 +299,12 @@ Datum sync_data(PG_FUNCTION_ARGS)
 
     /* load configuration */
     if(unlikely(SPI_execute_with_args("select id, version, quote_ident(schema_name), quote_ident(table_name), "
-            "quote_ident(id_column), quote_ident(molfile_column), segments, buffered_docs, buffer_size from "
+            "quote_ident(id_column), quote_ident(molfile_column), segments, buffered_docs, buffer_size, match_images, dense_fingerprints from "
             "sachem.configuration where index_name = $1", 1,
             (Oid[]) { VARCHAROID }, (Datum[]) { PointerGetDatum(index) }, NULL, true, 1) != SPI_OK_SELECT))
         elog(ERROR, "%s: SPI_execute_with_args() failed", __func__);
 
-    if(unlikely(SPI_processed != 1 || SPI_tuptable == NULL || SPI_tuptable->tupdesc->natts != 9))
+    if(unlikely(SPI_processed != 1 || SPI_tuptable == NULL || SPI_tuptable->tupdesc->natts != 11))
         elog(ERROR, "%s: SPI_execute_plan() failed", __func__);
 
     Datum indexId = SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
@@ -311,6 +316,8 @@ Datum sync_data(PG_FUNCTION_ARGS)
     int32 segments = DatumGetInt32(SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 7));
     int32 bufferedDocs = DatumGetInt32(SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 8));
     float8 bufferSize = DatumGetFloat8(SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 9));
+    bool matchImages = DatumGetBool(SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 10));
+    bool denseFingerprints = DatumGetBool(SPI_get_value(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 11));
     char *indexName = text_to_cstring(index);
 
 
@@ -337,7 +344,17 @@ Datum sync_data(PG_FUNCTION_ARGS)
 
     PG_TRY();
     {
-        indexer_begin(indexer, indexPath, segments, bufferedDocs, bufferSize);
+        bool rebuild = indexer_begin(indexer, indexPath, segments, bufferedDocs, bufferSize, matchImages, denseFingerprints);
+
+        /* an index with legacy fingerprint terms has been emptied, so all compounds are indexed again */
+        if(unlikely(rebuild))
+        {
+            elog(NOTICE, "converting the index to the current fingerprint format");
+
+            if(unlikely(SPI_execute_with_args("delete from sachem.compound_errors where index = $1", 1, (Oid[]) { INT4OID },
+                    (Datum[]) { indexId }, NULL, false, 0) != SPI_OK_DELETE))
+                elog(ERROR, "%s: SPI_execute_with_args() failed", __func__);
+        }
 
         /* delete unnecessary data */
         Portal auditCursor = SPI_cursor_open_with_args(NULL,
@@ -367,11 +384,15 @@ Datum sync_data(PG_FUNCTION_ARGS)
 
         /* convert new data */
         char *query = (char *) palloc(110 + 2 * strlen(idColumn) + strlen(molfileColumn) + strlen(schemaName) + strlen(tableName));
-        sprintf(query, "select cmp.%s, cmp.%s from %s.%s cmp, sachem.compound_audit aud where cmp.%s = aud.id and aud.index = $1",
-                idColumn, molfileColumn, schemaName, tableName, idColumn);
 
-        Portal compoundCursor = SPI_cursor_open_with_args(NULL, query, 1, (Oid[]) { INT4OID }, (Datum[]) { indexId },
-                NULL, false, CURSOR_OPT_BINARY | CURSOR_OPT_NO_SCROLL);
+        if(unlikely(rebuild))
+            sprintf(query, "select cmp.%s, cmp.%s from %s.%s cmp", idColumn, molfileColumn, schemaName, tableName);
+        else
+            sprintf(query, "select cmp.%s, cmp.%s from %s.%s cmp, sachem.compound_audit aud where cmp.%s = aud.id and aud.index = $1",
+                    idColumn, molfileColumn, schemaName, tableName, idColumn);
+
+        Portal compoundCursor = SPI_cursor_open_with_args(NULL, query, rebuild ? 0 : 1, (Oid[]) { INT4OID },
+                (Datum[]) { indexId }, NULL, false, CURSOR_OPT_BINARY | CURSOR_OPT_NO_SCROLL);
 
         uint64 count = 0;
 